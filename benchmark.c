@@ -0,0 +1,288 @@
+#define _GNU_SOURCE
+#include "benchmark.h"
+#include "parser.h"
+#include "execute.h"
+#include "jobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <wait.h>
+#include <sys/resource.h>
+
+#define BENCH_DEFAULT_RUNS 10
+
+/*
+    Summary holds the statistics of one series of samples, in seconds.
+*/
+typedef struct Summary {
+    double mean;
+    double stddev;
+    double median;
+    double min;
+    double max;
+    double p95;
+    double p99;
+    double q1;
+    double q3;
+} Summary;
+
+int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+    returns the p-quantile of sorted, interpolating between the two
+    closest ranks.
+*/
+double percentile(const double *sorted, int number, double p) {
+    double rank = p * (number - 1);
+    int low = (int)rank;
+    if (low + 1 >= number) {
+        return sorted[number - 1];
+    }
+    return sorted[low] + (rank - low) * (sorted[low + 1] - sorted[low]);
+}
+
+void summarize(const double *samples, int number, Summary *summary) {
+    double *sorted = (double *)malloc(sizeof(double) * number);
+    memcpy(sorted, samples, sizeof(double) * number);
+    qsort(sorted, number, sizeof(double), compare_double);
+    double sum = 0;
+    for (int i = 0; i < number; i++) {
+        sum += sorted[i];
+    }
+    summary->mean = sum / number;
+    double squares = 0;
+    for (int i = 0; i < number; i++) {
+        squares += (sorted[i] - summary->mean) * (sorted[i] - summary->mean);
+    }
+    summary->stddev = number > 1 ? sqrt(squares / (number - 1)) : 0;
+    summary->median = percentile(sorted, number, 0.5);
+    summary->min = sorted[0];
+    summary->max = sorted[number - 1];
+    summary->p95 = percentile(sorted, number, 0.95);
+    summary->p99 = percentile(sorted, number, 0.99);
+    summary->q1 = percentile(sorted, number, 0.25);
+    summary->q3 = percentile(sorted, number, 0.75);
+    free(sorted);
+}
+
+/*
+    returns text after its first number words, skipping blanks, which
+    is where the benchmarked command line starts.
+*/
+const char *skip_words(const char *text, int number) {
+    for (int i = 0; i < number; i++) {
+        text += strspn(text, " \t");
+        text += strcspn(text, " \t");
+    }
+    return text + strspn(text, " \t");
+}
+
+double seconds_between(const struct timeval *begin, const struct timeval *end) {
+    return (end->tv_sec - begin->tv_sec) + (end->tv_usec - begin->tv_usec) / 1e6;
+}
+
+/*
+    run_line parses command and executes it like the main loop does.
+    It returns false if the command did not parse.
+*/
+bool run_line(const char *command) {
+    Line *line = parse((char *)command);
+    if (line == NULL) {
+        return false;
+    }
+    execute(line);
+    return true;
+}
+
+void print_summary(const char *name, const Summary *summary) {
+    printf("%-6s%12.3lf%12.3lf%12.3lf%12.3lf%12.3lf%12.3lf%12.3lf\n", name, summary->mean * 1e3,
+           summary->stddev * 1e3, summary->median * 1e3, summary->min * 1e3, summary->max * 1e3,
+           summary->p95 * 1e3, summary->p99 * 1e3);
+}
+
+void export_json_summary(FILE *file, const char *name, const Summary *summary, const double *samples, int runs) {
+    fprintf(file, "  \"%s\": {\"mean\": %.9lf, \"stddev\": %.9lf, \"median\": %.9lf, \"min\": %.9lf, "
+                  "\"max\": %.9lf, \"p95\": %.9lf, \"p99\": %.9lf, \"times\": [",
+            name, summary->mean, summary->stddev, summary->median, summary->min, summary->max,
+            summary->p95, summary->p99);
+    for (int i = 0; i < runs; i++) {
+        fprintf(file, "%s%.9lf", i == 0 ? "" : ", ", samples[i]);
+    }
+    fprintf(file, "]}");
+}
+
+/*
+    export_results writes every run to a CSV file or the statistics and
+    every run to a JSON file, depending on json. Times are in seconds.
+*/
+void export_results(const char *path, bool json, const char *command, double *samples[3],
+                    Summary summaries[3], int runs) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "myshell: bench: can not open '%s': %s\n", path, strerror(errno));
+        return;
+    }
+    if (json) {
+        fprintf(file, "{\n  \"command\": \"");
+        for (const char *c = command; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') {
+                fputc('\\', file);
+            }
+            fputc(*c, file);
+        }
+        fprintf(file, "\",\n  \"runs\": %d,\n", runs);
+        export_json_summary(file, "wall", &summaries[0], samples[0], runs);
+        fprintf(file, ",\n");
+        export_json_summary(file, "user", &summaries[1], samples[1], runs);
+        fprintf(file, ",\n");
+        export_json_summary(file, "sys", &summaries[2], samples[2], runs);
+        fprintf(file, "\n}\n");
+    } else {
+        fprintf(file, "run,wall,user,sys\n");
+        for (int i = 0; i < runs; i++) {
+            fprintf(file, "%d,%.9lf,%.9lf,%.9lf\n", i + 1, samples[0][i], samples[1][i], samples[2][i]);
+        }
+    }
+    fclose(file);
+}
+
+/*
+    bench_builtin runs the command line after its options warmup times
+    untimed and then runs times, each through parse() and execute() as
+    if it had been typed, preceded by the --prepare command. Wall time
+    comes from CLOCK_MONOTONIC around execute() and user/sys time from
+    the RUSAGE_CHILDREN difference, so no extra shell is spawned per
+    run. The output of the runs goes to /dev/null unless --show-output
+    is given. Runs with a wall time beyond 1.5 interquartile ranges are
+    reported as outliers. A run killed by SIGINT stops the benchmark.
+*/
+void bench_builtin(int argc, char **argv, const char *text) {
+    int runs = BENCH_DEFAULT_RUNS;
+    int warmup = 0;
+    const char *prepare = NULL;
+    const char *csv = NULL;
+    const char *json = NULL;
+    bool show_output = false;
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--show-output") == 0) {
+            show_output = true;
+        } else if (strcmp(argv[i], "-n") == 0 && has_value) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-w") == 0 && has_value) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--prepare") == 0 && has_value) {
+            prepare = argv[++i];
+        } else if (strcmp(argv[i], "--export-csv") == 0 && has_value) {
+            csv = argv[++i];
+        } else if (strcmp(argv[i], "--export-json") == 0 && has_value) {
+            json = argv[++i];
+        } else {
+            fprintf(stderr, "myshell: bench: bad option '%s'\n", argv[i]);
+            return;
+        }
+    }
+    if (runs <= 0 || warmup < 0) {
+        fprintf(stderr, "myshell: bench: the number of runs must be positive\n");
+        return;
+    }
+    if (i == argc) {
+        fprintf(stderr, "myshell: bench: missing command\n");
+        return;
+    }
+    char *command = strdup(skip_words(text, i));
+
+    int saved_stdout = -1;
+    fflush(stdout);
+    if (!show_output) {
+        int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    double *samples[3];
+    for (int k = 0; k < 3; k++) {
+        samples[k] = (double *)malloc(sizeof(double) * runs);
+    }
+    int done = 0;
+    int failed = 0;
+    bool interrupted = false;
+    for (int run = 0; run < warmup + runs && !interrupted; run++) {
+        if (prepare != NULL) {
+            run_line(prepare);
+        }
+        struct rusage before;
+        struct rusage after;
+        struct timespec begin;
+        struct timespec end;
+        Line *line = parse(command);
+        if (line == NULL) {
+            break;
+        }
+        getrusage(RUSAGE_CHILDREN, &before);
+        clock_gettime(CLOCK_MONOTONIC, &begin);
+        execute(line);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        getrusage(RUSAGE_CHILDREN, &after);
+        int status = last_status();
+        interrupted = WIFSIGNALED(status) && WTERMSIG(status) == SIGINT;
+        if (run < warmup || interrupted) {
+            continue;
+        }
+        failed += status != 0;
+        samples[0][done] = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+        samples[1][done] = seconds_between(&before.ru_utime, &after.ru_utime);
+        samples[2][done] = seconds_between(&before.ru_stime, &after.ru_stime);
+        ++done;
+    }
+    if (saved_stdout != -1) {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+
+    if (done > 0) {
+        Summary summaries[3];
+        for (int k = 0; k < 3; k++) {
+            summarize(samples[k], done, &summaries[k]);
+        }
+        printf("bench: %s\n", command);
+        printf("%d runs, %d warmup%s\n", done, warmup, interrupted ? ", interrupted" : "");
+        printf("%-6s%12s%12s%12s%12s%12s%12s%12s\n", "ms", "mean", "stddev", "median", "min", "max", "p95", "p99");
+        print_summary("wall", &summaries[0]);
+        print_summary("user", &summaries[1]);
+        print_summary("sys", &summaries[2]);
+        double range = summaries[0].q3 - summaries[0].q1;
+        int outliers = 0;
+        for (int k = 0; k < done; k++) {
+            outliers += samples[0][k] < summaries[0].q1 - 1.5 * range || samples[0][k] > summaries[0].q3 + 1.5 * range;
+        }
+        if (outliers > 0) {
+            printf("Warning: %d of %d runs are statistical outliers; the system may be busy, "
+                   "try more runs or warmup runs.\n", outliers, done);
+        }
+        if (failed > 0) {
+            printf("Warning: %d runs ended with a non-zero status.\n", failed);
+        }
+        fflush(stdout);
+        if (csv != NULL) {
+            export_results(csv, false, command, samples, summaries, done);
+        }
+        if (json != NULL) {
+            export_results(json, true, command, samples, summaries, done);
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        free(samples[k]);
+    }
+    free(command);
+}
@@ -0,0 +1,11 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+/*
+    "bench [-n runs] [-w warmup] [--prepare cmd] [--show-output]
+    [--export-csv file] [--export-json file] <command line>" runs the
+    command line repeatedly through execute() and reports statistics
+    of its wall, user and sys time. text is the whole bench line.
+*/
+void bench_builtin(int argc, char **argv, const char *text);
+#endif //BENCHMARK_H
@@ -0,0 +1,370 @@
+#include "builtin.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern char ** environ;
+
+/*
+    cd changes to dir, to $HOME without one or to $OLDPWD for "-",
+    and keeps PWD and OLDPWD up to date.
+*/
+int cdBuiltin(int argc, char ** argv) {
+    if (argc>2) {
+        fprintf(stderr,"myshell: cd: too many arguments\n");
+        return 1;
+    }
+    const char * dir=argc==2?argv[1]:getenv("HOME");
+    bool back=dir!=nullptr&&strcmp(dir,"-")==0;
+    if (back) {
+        dir=getenv("OLDPWD");
+    }
+    if (dir==nullptr) {
+        fprintf(stderr,"myshell: cd: %s not set\n",back?"OLDPWD":"HOME");
+        return 1;
+    }
+    char previous[PATH_MAX];
+    bool known=getcwd(previous,sizeof(previous))!=nullptr;
+    if (chdir(dir)==-1) {
+        fprintf(stderr,"myshell: cd: %s: %s\n",dir,strerror(errno));
+        return 1;
+    }
+    if (known) {
+        setenv("OLDPWD",previous,1);
+    }
+    char current[PATH_MAX];
+    if (getcwd(current,sizeof(current))!=nullptr) {
+        setenv("PWD",current,1);
+        if (back) {
+            printf("%s\n",current);
+        }
+    }
+    return 0;
+}
+
+int pwdBuiltin(int argc, char ** argv) {
+    char current[PATH_MAX];
+    if (getcwd(current,sizeof(current))==nullptr) {
+        fprintf(stderr,"myshell: pwd: %s\n",strerror(errno));
+        return 1;
+    }
+    printf("%s\n",current);
+    return 0;
+}
+
+/*
+    echo prints its arguments separated by blanks; -n leaves out the
+    newline.
+*/
+int echoBuiltin(int argc, char ** argv) {
+    int i=1;
+    bool newline=true;
+    if (argc>1&&strcmp(argv[1],"-n")==0) {
+        newline=false;
+        ++i;
+    }
+    for (;i<argc;++i) {
+        fputs(argv[i],stdout);
+        if (i+1<argc) {
+            putchar(' ');
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+bool isName(const char * name, size_t length) {
+    size_t i=0;
+    if (length==0||(name[0]>='0'&&name[0]<='9')) {
+        return false;
+    }
+    for (i=0;i!=length;++i) {
+        char c=name[i];
+        if (!(c=='_'||(c>='a'&&c<='z')||(c>='A'&&c<='Z')||(c>='0'&&c<='9'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    export NAME=value sets NAME in the environment of the shell and
+    of every command started after it. Without arguments it prints
+    the environment.
+*/
+int exportBuiltin(int argc, char ** argv) {
+    if (argc==1) {
+        char ** variable=environ;
+        for (;*variable!=nullptr;++variable) {
+            printf("export %s\n",*variable);
+        }
+        return 0;
+    }
+    int status=0;
+    int i=1;
+    for (i=1;i<argc;++i) {
+        char * equal=strchr(argv[i],'=');
+        size_t length=equal!=nullptr?(size_t)(equal-argv[i]):strlen(argv[i]);
+        if (!isName(argv[i],length)) {
+            fprintf(stderr,"myshell: export: '%s': not a valid identifier\n",argv[i]);
+            status=1;
+        } else if (equal!=nullptr) {
+            *equal='\0';
+            setenv(argv[i],equal+1,1);
+            *equal='=';
+        }
+    }
+    return status;
+}
+
+int trueBuiltin(int argc, char ** argv) {
+    return 0;
+}
+
+int falseBuiltin(int argc, char ** argv) {
+    return 1;
+}
+
+/*
+    TestState walks the arguments of test: position is the next one
+    to read and error is set when they do not form an expression.
+*/
+typedef struct TestState {
+    int argc;
+    char ** argv;
+    int position;
+    bool error;
+} TestState;
+
+bool isUnaryTest(const char * op) {
+    return op[0]=='-'&&op[1]!='\0'&&op[2]=='\0'&&strchr("defhLnrswxz",op[1])!=nullptr;
+}
+
+bool isBinaryTest(const char * op) {
+    static const char * ops[]={"=","==","!=","-eq","-ne","-lt","-le","-gt","-ge"};
+    size_t i=0;
+    for (i=0;i!=sizeof(ops)/sizeof(ops[0]);++i) {
+        if (strcmp(op,ops[i])==0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+long testNumber(TestState * state, const char * text) {
+    char * end=nullptr;
+    errno=0;
+    long value=strtol(text,&end,10);
+    if (end==text||*end!='\0'||errno!=0) {
+        fprintf(stderr,"myshell: test: %s: integer expression expected\n",text);
+        state->error=true;
+    }
+    return value;
+}
+
+bool testUnary(char op, const char * operand) {
+    struct stat info;
+    if (op=='n') {
+        return operand[0]!='\0';
+    } else if (op=='z') {
+        return operand[0]=='\0';
+    } else if (op=='r') {
+        return access(operand,R_OK)==0;
+    } else if (op=='w') {
+        return access(operand,W_OK)==0;
+    } else if (op=='x') {
+        return access(operand,X_OK)==0;
+    } else if (op=='h'||op=='L') {
+        return lstat(operand,&info)==0&&S_ISLNK(info.st_mode);
+    }
+    if (stat(operand,&info)!=0) {
+        return false;
+    }
+    if (op=='f') {
+        return S_ISREG(info.st_mode);
+    } else if (op=='d') {
+        return S_ISDIR(info.st_mode);
+    } else if (op=='s') {
+        return info.st_size>0;
+    }
+    return true;
+}
+
+bool testBinary(TestState * state, const char * left, const char * op, const char * right) {
+    if (strcmp(op,"=")==0||strcmp(op,"==")==0) {
+        return strcmp(left,right)==0;
+    } else if (strcmp(op,"!=")==0) {
+        return strcmp(left,right)!=0;
+    }
+    long a=testNumber(state,left);
+    long b=testNumber(state,right);
+    if (strcmp(op,"-eq")==0) {
+        return a==b;
+    } else if (strcmp(op,"-ne")==0) {
+        return a!=b;
+    } else if (strcmp(op,"-lt")==0) {
+        return a<b;
+    } else if (strcmp(op,"-le")==0) {
+        return a<=b;
+    } else if (strcmp(op,"-gt")==0) {
+        return a>b;
+    }
+    return a>=b;
+}
+
+bool testOr(TestState * state);
+
+/*
+    testPrimary reads "( expression )", "string op string", "-op
+    operand" or a single string, which is true if it is not empty.
+    A binary operator in the middle wins, so "test -n = -n" compares.
+*/
+bool testPrimary(TestState * state) {
+    if (state->position>=state->argc) {
+        fprintf(stderr,"myshell: test: argument expected\n");
+        state->error=true;
+        return false;
+    }
+    char ** argv=state->argv+state->position;
+    int left=state->argc-state->position;
+    if (left>=3&&isBinaryTest(argv[1])) {
+        state->position+=3;
+        return testBinary(state,argv[0],argv[1],argv[2]);
+    }
+    if (left>=2&&isUnaryTest(argv[0])) {
+        state->position+=2;
+        return testUnary(argv[0][1],argv[1]);
+    }
+    if (left>=2&&strcmp(argv[0],"(")==0) {
+        ++state->position;
+        bool result=testOr(state);
+        if (state->position>=state->argc||strcmp(state->argv[state->position],")")!=0) {
+            fprintf(stderr,"myshell: test: ')' expected\n");
+            state->error=true;
+        }
+        ++state->position;
+        return result;
+    }
+    ++state->position;
+    return argv[0][0]!='\0';
+}
+
+bool testNot(TestState * state) {
+    char ** argv=state->argv+state->position;
+    int left=state->argc-state->position;
+    if (left>=2&&strcmp(argv[0],"!")==0&&!(left==3&&isBinaryTest(argv[1]))) {
+        ++state->position;
+        return !testNot(state);
+    }
+    return testPrimary(state);
+}
+
+bool testAnd(TestState * state) {
+    bool result=testNot(state);
+    while (state->position<state->argc&&strcmp(state->argv[state->position],"-a")==0) {
+        ++state->position;
+        result=testNot(state)&&result;
+    }
+    return result;
+}
+
+bool testOr(TestState * state) {
+    bool result=testAnd(state);
+    while (state->position<state->argc&&strcmp(state->argv[state->position],"-o")==0) {
+        ++state->position;
+        result=testAnd(state)||result;
+    }
+    return result;
+}
+
+/*
+    test (and "[", which needs a closing "]") evaluates its
+    arguments: string and integer comparisons, the file tests
+    -d -e -f -h -L -r -s -w -x, -n and -z, combined with !, -a, -o
+    and parentheses. The status is 0 for true, 1 for false and 2 for
+    an invalid expression.
+*/
+int testBuiltin(int argc, char ** argv) {
+    if (strcmp(argv[0],"[")==0) {
+        if (strcmp(argv[argc-1],"]")!=0) {
+            fprintf(stderr,"myshell: [: missing ']'\n");
+            return 2;
+        }
+        --argc;
+    }
+    if (argc==1) {
+        return 1;
+    }
+    TestState state={argc,argv,1,false};
+    bool result=testOr(&state);
+    if (!state.error&&state.position<argc) {
+        fprintf(stderr,"myshell: test: %s: unexpected argument\n",argv[state.position]);
+        state.error=true;
+    }
+    return state.error?2:!result;
+}
+
+static const Builtin builtins[]={
+    {"cd",cdBuiltin},
+    {"pwd",pwdBuiltin},
+    {"echo",echoBuiltin},
+    {"export",exportBuiltin},
+    {"true",trueBuiltin},
+    {"false",falseBuiltin},
+    {"test",testBuiltin},
+    {"[",testBuiltin},
+};
+
+/*
+    slots is an open addressing table over builtins, filled on the
+    first lookup, so that finding a name costs one hash and usually
+    one strcmp whatever the number of built-ins.
+*/
+static const Builtin * slots[BUILTIN_SLOTS];
+static bool slotsReady=false;
+
+unsigned int builtinSlot(const char * name) {
+    unsigned int hash=2166136261u;
+    while (*name) {
+        hash=(hash^(unsigned char)*name++)*16777619u;
+    }
+    return hash%BUILTIN_SLOTS;
+}
+
+const Builtin * findBuiltin(const char * name) {
+    size_t i=0;
+    if (!slotsReady) {
+        for (i=0;i!=sizeof(builtins)/sizeof(builtins[0]);++i) {
+            unsigned int slot=builtinSlot(builtins[i].name);
+            while (slots[slot]!=nullptr) {
+                slot=(slot+1)%BUILTIN_SLOTS;
+            }
+            slots[slot]=&builtins[i];
+        }
+        slotsReady=true;
+    }
+    unsigned int slot=builtinSlot(name);
+    while (slots[slot]!=nullptr) {
+        if (strcmp(slots[slot]->name,name)==0) {
+            return slots[slot];
+        }
+        slot=(slot+1)%BUILTIN_SLOTS;
+    }
+    return nullptr;
+}
+
+/*
+    runBuiltin runs builtin and flushes what it printed, so that the
+    output is complete before the shell or the child goes on.
+*/
+int runBuiltin(const Builtin * builtin, int argc, char ** argv) {
+    int status=builtin->run(argc,argv);
+    fflush(stdout);
+    return status;
+}
@@ -0,0 +1,19 @@
+#ifndef BUILTIN_H
+#define BUILTIN_H
+#include "util.h"
+
+#define BUILTIN_SLOTS 32
+
+/*
+    A Builtin is a command run by the shell without an exec: on its
+    own it runs in the shell process, inside a pipeline or in
+    background in the forked child. run returns the exit status.
+*/
+typedef struct Builtin {
+    const char * name;
+    int (*run)(int argc, char ** argv);
+} Builtin;
+
+const Builtin * findBuiltin(const char * name);
+int runBuiltin(const Builtin * builtin, int argc, char ** argv);
+#endif //BUILTIN_H
@@ -0,0 +1,90 @@
+#define _GNU_SOURCE
+#include "capture.h"
+#include "parser.h"
+#include "execute.h"
+#include "jobs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/*
+    readCapture reads fd until end of file straight into the free
+    space of the output buffer. The buffer doubles whenever less than
+    CAPTURE_MIN_READ bytes are free, so n bytes take O(log n)
+    reallocations, and with a CAPTURE_PIPE_SIZE pipe every read()
+    returns as much as the writer managed to put in it.
+*/
+void readCapture(int fd, Capture * capture) {
+    TextBuffer * output=&capture->output;
+    while (true) {
+        size_t capacity=output->capacity;
+        reserveText(output,CAPTURE_MIN_READ);
+        capture->grows+=output->capacity!=capacity;
+        ssize_t result=read(fd,output->data+output->size,output->capacity-output->size-1);
+        if (result==-1&&errno==EINTR) {
+            continue;
+        }
+        if (result<=0) {
+            break;
+        }
+        ++capture->reads;
+        output->size+=result;
+    }
+    output->data[output->size]='\0';
+}
+
+/*
+    captureOutput runs command like a line of its own, through parse()
+    and execute(), with its stdout going into capture->output; the
+    trailing newlines are removed. It runs in a forked copy of the
+    shell, like a subshell, so that cd, export or exit in command do
+    not change the shell itself, while the shell reads the pipe as
+    the command writes it: no temporary file is involved. It returns
+    false if the pipe or the fork could not be created.
+*/
+bool captureOutput(const char * command, Capture * capture) {
+    initText(&capture->output);
+    capture->output.data[0]='\0';
+    capture->reads=0;
+    capture->grows=0;
+    int pipefd[2];
+    if (pipe2(pipefd,O_CLOEXEC)==-1) {
+        fprintf(stderr,"myshell: can not create pipe: %s\n",strerror(errno));
+        return false;
+    }
+    fcntl(pipefd[1],F_SETPIPE_SZ,CAPTURE_PIPE_SIZE);
+    fflush(stdout);
+    pid_t pid=fork();
+    if (pid==-1) {
+        fprintf(stderr,"myshell: can not fork: %s\n",strerror(errno));
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return false;
+    }
+    if (pid==0) {
+        close(pipefd[0]);
+        dup2(pipefd[1],STDOUT_FILENO);
+        close(pipefd[1]);
+        Line * line=parse((char*)command);
+        if (line!=nullptr&&line->type!=EXIT_TYPE) {
+            execute(line);
+        }
+        fflush(stdout);
+        _exit(WEXITSTATUS(last_status()));
+    }
+    close(pipefd[1]);
+    readCapture(pipefd[0],capture);
+    close(pipefd[0]);
+    while (waitpid(pid,nullptr,0)==-1&&errno==EINTR) {
+    }
+    TextBuffer * output=&capture->output;
+    while (output->size!=0&&output->data[output->size-1]=='\n') {
+        --output->size;
+    }
+    output->data[output->size]='\0';
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#include "util.h"
+
+#define CAPTURE_PIPE_SIZE (1 << 20)
+#define CAPTURE_MIN_READ (64 * 1024)
+
+/*
+    Capture is the output of a command substitution. reads and grows
+    count the read() calls and the reallocations it took.
+*/
+typedef struct Capture {
+    TextBuffer output;
+    size_t reads;
+    size_t grows;
+} Capture;
+
+bool captureOutput(const char * command, Capture * capture);
+#endif //CAPTURE_H
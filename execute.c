@@ -1,176 +1,336 @@
+#define _GNU_SOURCE
 #include "execute.h"
 #include "sig.h"
 #include "viewtree.h"
+#include "spawn.h"
+#include "fanout.h"
+#include "pathcache.h"
+#include "jobs.h"
+#include "parallel.h"
+#include "benchmark.h"
+#include "history.h"
+#include "redirect.h"
+#include "builtin.h"
+#include "limit.h"
+#include "placement.h"
 #include <unistd.h>
+#include <fcntl.h>
 #include <wait.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
 
-extern sig_atomic_t sigusr1_flag;
-extern sig_atomic_t timeX_flag;
 
 
+/*
+    run_command spawns cmd with in and out as its stdin and stdout
+    (-1 keeps the shell's own) and adds it to job. The program is
+    exec'd through the path cache so PATH is not searched with
+    failing execve() calls; a built-in runs in the child instead.
+    The first process of a job starts a new process group which the
+    others join; for a foreground job it also takes the terminal.
+    For "timeX -e" the child is held before its exec until its perf
+    counters are open. A job run with "limit" has every child set
+    its rlimits and move into the cgroup of the job before the exec.
+    The placement of cmd is applied there too; in a job run with
+    @spread a command without CPUs of its own gets the next CPU of
+    the spread order. Redirections are opened here and applied by
+    the child with dup2 after in and out; if one can not be opened
+    nothing is spawned. It returns the pid of the child or -1 if it
+    could not be created.
+*/
+pid_t run_command(Command *cmd, int in, int out, Job *job) {
+    RedirectSet redirects;
+    if (!openRedirects(cmd, &redirects)) {
+        return -1;
+    }
+    SpawnAttr attr;
+    initSpawnAttr(&attr);
+    attr.builtin=findBuiltin(cmd->argv[0]);
+    if (attr.builtin == NULL) {
+        attr.path=resolveCommand(cmd->argv[0]);
+    }
+    attr.stdinFd=in;
+    attr.stdoutFd=out;
+    attr.pgid=job->pgid;
+    attr.redirects=redirects.pairs;
+    attr.redirectNumber=redirects.number;
+    SpawnLimit limits[LIMIT_RESOURCES];
+    if (job->limits != NULL) {
+        attr.limits=limits;
+        attr.limitNumber=spawnLimits(job->limits, job->cgroup != NULL, limits);
+        attr.cgroupFd=job->cgroup != NULL ? job->cgroup->procsFd : -1;
+    }
+    Placement spread;
+    attr.placement=cmd->placement;
+    if (job->spread >= 0 && (cmd->placement == NULL || !cmd->placement->hasCpus)) {
+        if (cmd->placement != NULL) {
+            spread = *cmd->placement;
+        } else {
+            initPlacement(&spread);
+        }
+        if (spreadCpu(job->spread, &spread)) {
+            ++job->spread;
+            attr.placement=&spread;
+        }
+    }
+    if (job->pgid == 0 && !job->background) {
+        attr.terminalFd=terminal_fd();
+    }
+    int hold[2] = {-1, -1};
+    if (job->events != NULL && pipe2(hold, O_CLOEXEC) == 0) {
+        attr.holdFd=hold[0];
+    }
+    struct timespec started;
+    if (job->timed) {
+        clock_gettime(CLOCK_MONOTONIC, &started);
+    }
+    pid_t pid = spawnCommand(cmd->argv,&attr);
+    closeRedirects(&redirects);
+    PerfCounters counters = {0};
+    if (pid > 0 && attr.holdFd != -1) {
+        openCounters(job->events, pid, &counters);
+    }
+    if (attr.holdFd != -1) {
+        write(hold[1], "", 1);
+        close(hold[0]);
+        close(hold[1]);
+    }
+    if (pid > 0) {
+        add_process(job, pid, cmd->argv[0], &started, &counters);
+    }
+    return pid;
+}
 
-void run_command(Command *cmd, int is_background) {
-    if (is_background) {
-        setpgid(0, 0); //put the child process into another group of processes.
-    }
-    while(sigusr1_flag == 0);
-    execvp(cmd->argv[0], cmd->argv);
-    fprintf(stderr, "myshell: '%s': %s\n", cmd->argv[0], strerror(errno));
-    exit(EXIT_FAILURE);
+/*
+    run_pipeline spawns the commands starting at head, connecting them
+    with close-on-exec pipes. The first command reads from in and the last
+    one writes to out (-1 keeps the shell's own). Each end is closed as soon
+    as the stage that inherits it has been spawned, including in and out, so
+    the shell holds at most three pipe fds at any time. Every process is
+    added to job.
+*/
+void run_pipeline(Command *head, int in, int out, Job *job) {
+    Command *iterator = head;
+    for (; iterator != NULL; iterator = iterator->next) {
+        int pipefd[2] = {-1, out};
+        if (iterator->next != NULL && pipe2(pipefd, O_CLOEXEC) == -1) {
+            fprintf(stderr, "myshell: can not create pipe: %s\n", strerror(errno));
+            break;
+        }
+        run_command(iterator, in, pipefd[1], job);
+        if (in != -1) {
+            close(in);
+        }
+        if (pipefd[1] != -1) {
+            close(pipefd[1]);
+        }
+        in = pipefd[0];
+    }
+    if (in != -1) {
+        close(in);
+    }
+    if (iterator != NULL && out != -1) {
+        close(out);
+    }
 }
 
 /*
-    If it is a background process, wait_wrapped doesn't wait and returns.
-    Else it allows the parent process to ignore SIGINT. 
+    run_fanout runs "producer |{ consumerA , consumerB }". The producer
+    pipeline writes into one pipe and every branch reads from its own pipe.
+    The shell relays between them with tee(2)/splice(2) in fanOut, so no tee
+    process is needed and the data never enters user space. A foreground line
+    relays in the shell itself, a background one in a forked helper which
+    joins the process group of the job.
 */
-void wait_wrapped(int pid, int is_background, int flag) {
-    if (!is_background) {
-        struct sigaction act;
-        sigaction(SIGINT,nullptr,&act);
-        signal(SIGINT,SIG_IGN);
-        waitid(P_PID, pid, NULL, WNOWAIT | WEXITED);
-        sigaction(SIGINT,&act,nullptr);
+void run_fanout(Line *line, Job *job) {
+    int source[2];
+    if (pipe2(source, O_CLOEXEC) == -1) {
+        fprintf(stderr, "myshell: can not create pipe: %s\n", strerror(errno));
+        return;
     }
+    run_pipeline(line->head, -1, source[1], job);
+    int *sinks = (int *)malloc(sizeof(int) * line->branchNumber);
+    int sink_number = 0;
+    for (int i = 0; i < line->branchNumber; i++) {
+        int pipefd[2];
+        if (pipe2(pipefd, O_CLOEXEC) == -1) {
+            fprintf(stderr, "myshell: can not create pipe: %s\n", strerror(errno));
+            break;
+        }
+        sinks[sink_number++] = pipefd[1];
+        run_pipeline(line->branch[i], pipefd[0], -1, job);
+    }
+    if (!line->background) {
+        fanOut(source[0], sinks, sink_number);
+    } else {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            setpgid(0, job->pgid);
+            fanOut(source[0], sinks, sink_number);
+            _exit(EXIT_SUCCESS);
+        }
+        if (pid > 0) {
+            setpgid(pid, job->pgid == 0 ? pid : job->pgid);
+            add_process(job, pid, "myshell", NULL, NULL);
+        }
+        close(source[0]);
+        for (int i = 0; i < sink_number; i++) {
+            close(sinks[i]);
+        }
+    }
+    free(sinks);
 }
 
 /*
-    This is a wrapped version of fork().
-    It sets sigusr1_flag to 0 (refer to sig.c)
-    and execute fork(). If fork fails it 
-    prints error and returns -1. If succeeds, the parent
-    process sends a SIGUSR1 to pid and then returns the pid. 
+    run_parallel runs a line whose last command is parallel. The commands
+    before it form a pipeline writing into a pipe from which parallel
+    reads its arguments; they and every child of parallel belong to job.
 */
-int safe_fork() {
-    sigusr1_flag = 0;
-    int pid = fork();
-    if (pid == -1) {
-        fprintf(stderr, "can not fork\n");
-        return -1;
+void run_parallel(Line *line, Job *job) {
+    Command *previous = NULL;
+    Command *last = line->head;
+    while (last->next != NULL) {
+        previous = last;
+        last = last->next;
     }
-    if (pid>0) {
-        kill(pid, SIGUSR1);
+    int in = -1;
+    if (previous != NULL) {
+        int pipefd[2];
+        if (pipe2(pipefd, O_CLOEXEC) == -1) {
+            fprintf(stderr, "myshell: can not create pipe: %s\n", strerror(errno));
+            return;
+        }
+        previous->next = NULL;
+        run_pipeline(line->head, -1, pipefd[1], job);
+        in = pipefd[0];
     }
-    return pid;
+    parallel_builtin(last, in, job);
 }
 
 /*
     It executes the Line accordingly. If the Line->type is exit, 
     it prints the message, releases memory and exits. If the Line->type
-    is viewtree, it releases memory and calls viewTree. If the Line->type
-    is TIMEX_TYPE, it sets the timeX_flag to 1. If there's no piping, 
-    It forks a new child and executes the command while the parent process will wait for it.
-    If there's piping, iterates through all the commands.
+    is viewtree, it calls viewtreeBuiltin. If it is hash,
+    it calls hashBuiltin, and jobs, fg, bg and wait go to the job table.
+    history prints the entries of the history file.
+    A standalone command of the built-in table runs in the shell
+    without a fork and its status becomes the last status.
+    bench runs the rest of the line repeatedly through execute() itself.
+    A built-in other than exit and bench runs with its redirections
+    applied to the shell's own fds, which are restored afterwards.
+    Otherwise the line becomes a Job, with a transient cgroup when it
+    is run with "limit": run_pipeline connects any number
+    of commands, a trailing fan-out is handled by run_fanout and a
+    trailing parallel by run_parallel, and
+    start_job waits for a foreground job, printing timeX statistics if
+    Line->type is TIMEX_TYPE, or leaves a background one running.
 */
 void execute(Line *line) {
+    RedirectSet saved = {0};
+    if (line->type < 0 && line->type != EXIT_TYPE && line->type != BENCH_TYPE && line->head->redirects != NULL) {
+        if (!redirectShell(line->head, &saved)) {
+            freeLine(line);
+            return;
+        }
+    }
     if (line->type ==EXIT_TYPE) {
         fprintf(stderr, "myshell: Terminated\n");
         freeLine(line);
         exit(EXIT_SUCCESS);
     } else if (line->type==VIEWTREE_TYPE) {
+        viewtreeBuiltin(line->head->argc, line->head->argv);
+        freeLine(line);
+    } else if (line->type==HASH_TYPE) {
+        hashBuiltin(line->head->argc, line->head->argv);
+        freeLine(line);
+    } else if (line->type==JOBS_TYPE) {
+        jobs_builtin(line->head->argc, line->head->argv);
+        freeLine(line);
+    } else if (line->type==FG_TYPE) {
+        fg_builtin(line->head->argc, line->head->argv);
+        freeLine(line);
+    } else if (line->type==BG_TYPE) {
+        bg_builtin(line->head->argc, line->head->argv);
+        freeLine(line);
+    } else if (line->type==WAIT_TYPE) {
+        wait_builtin(line->head->argc, line->head->argv);
+        freeLine(line);
+    } else if (line->type==HISTORY_TYPE) {
+        historyBuiltin(line->head->argc, line->head->argv);
+        freeLine(line);
+    } else if (line->type==BUILTIN_TYPE) {
+        int status = runBuiltin(findBuiltin(line->head->argv[0]), line->head->argc, line->head->argv);
+        set_last_status(W_EXITCODE(status, 0));
+        freeLine(line);
+    } else if (line->type==BENCH_TYPE) {
+        bench_builtin(line->head->argc, line->head->argv, line->text);
         freeLine(line);
-        viewTree();
     } else {
-        if (line->type==TIMEX_TYPE) {
-            timeX_flag=1;
+        PerfEventSet *events = NULL;
+        if (line->events != nullptr) {
+            events = (PerfEventSet *)malloc(sizeof(PerfEventSet));
+            if (!parseEvents(line->events, events)) {
+                free(events);
+                freeLine(line);
+                return;
+            }
         }
-        if (line->head->next == NULL) {
-            int pid = safe_fork();
-            if (pid == 0) {
-                run_command(line->head, line->background);
-            }else if (pid > 0) {
-                wait_wrapped(pid, line->background, line->type);
+        Job *job = create_job(line->text, line->background, line->type == TIMEX_TYPE);
+        job->events = events;
+        job->spread = line->spread ? 0 : -1;
+        if (line->limits != nullptr) {
+            job->limits = (ResourceLimits *)malloc(sizeof(ResourceLimits));
+            *job->limits = *line->limits;
+            job->cgroup = createCgroup(job->limits, job->id);
+            if (job->cgroup == NULL && job->limits->cpu > 0) {
+                fprintf(stderr, "myshell: limit: --cpu needs a writable cgroup v2, ignored\n");
             }
-        } else {
-            Command *iterator = line->head;
-            int pipefd[MAX_PIPE_NUMBER][2];
-            pid_t pid_list[MAX_PIPE_NUMBER] = {0};
-            int pipe_number = 0;
-            pipe(pipefd[pipe_number]);
-            pid_t pid = safe_fork();
-            pid_list[pipe_number] = pid;
-            if (pid == 0) {                          //piping first command.
-                pipe_out(pipefd[pipe_number]);
-                run_command(iterator, line->background);
-            } 
-            while(iterator->next->next != NULL) {  //piping intermediate commands
-                iterator = iterator -> next;
-                ++pipe_number;
-                pipe(pipefd[pipe_number]);
-                pid_t pid = safe_fork();
-                pid_list[pipe_number] = pid;
-                if(pid == 0) {
-                    pipe_in(pipefd[pipe_number-1]);
-                    pipe_out(pipefd[pipe_number]);
-                    run_command(iterator, line->background);
-                }else if (pid > 0) {
-                    close_pipe(pipefd[pipe_number-1]);
-                }
+            if (job->cgroup == NULL && job->limits->memory > 0) {
+                fprintf(stderr, "myshell: limit: --mem needs a writable cgroup v2, limiting the address space instead\n");
             }
-            iterator = iterator->next;
-            pid = safe_fork();
-
-            if (pid == 0) { // piping last command.
-                pipe_in(pipefd[pipe_number]);
-                run_command(iterator, line->background);
-            }else if (pid > 0) {
-                close_pipe(pipefd[pipe_number]);
+            if (job->cgroup == NULL && job->limits->pids > 0) {
+                fprintf(stderr, "myshell: limit: --pids needs a writable cgroup v2, limiting the processes of the user instead\n");
             }
-            wait_wrapped(pid, line->background, line->type);
-           
-            for (size_t i = 0; i < pipe_number + 1; i++) {
-                wait_wrapped(pid_list[i], line->background, line->type);
-            }    
+        }
+        if (line->type == PARALLEL_TYPE) {
+            run_parallel(line, job);
+        } else if (line->branchNumber == 0) {
+            run_pipeline(line->head, -1, -1, job);
+        } else {
+            run_fanout(line, job);
         }
         freeLine(line);
+        start_job(job);
     }
+    restoreShell(&saved);
 }
 
 /*
-    print_timeX reads /proc/pid/stat to get the corresponding
-    statistics and prints the required information.
+    print_timeX prints the statistics of one process of a timed line
+    when it is reaped. runtime is the CLOCK_MONOTONIC time from its
+    spawn to its reap and usage is what wait4() returned for it, so
+    nothing is read from /proc and every stage of a pipeline gets its
+    own line. header prints the column names first.
 */
-void print_timeX(pid_t pid) {
-    int pid_get;
-    char cmd[MAX_PROC_FILE_PATH];
-    unsigned long ut, st;
-
-    char str[MAX_PROC_FILE_PATH];
-    sprintf(str, "/proc/%d/stat", pid);
-    FILE *file = fopen(str, "r");
-    if (file == NULL) {
-        return;
+void print_timeX(pid_t pid, const char *name, double runtime, const struct rusage *usage, bool header) {
+    char rtime[32];
+    char utime[32];
+    char stime[32];
+    char maxrss[32];
+    snprintf(rtime, sizeof(rtime), "%.6lf s", runtime);
+    snprintf(utime, sizeof(utime), "%.6lf s", usage->ru_utime.tv_sec + usage->ru_utime.tv_usec / 1e6);
+    snprintf(stime, sizeof(stime), "%.6lf s", usage->ru_stime.tv_sec + usage->ru_stime.tv_usec / 1e6);
+    snprintf(maxrss, sizeof(maxrss), "%ld KB", usage->ru_maxrss);
+    if (header) {
+        printf("\n%-10s%-15s%-13s%-13s%-13s%-12s%-10s%-10s%-10s%-10s\n", "PID", "CMD", "RTIME", "UTIME", "STIME",
+               "MAXRSS", "MINFLT", "MAJFLT", "VCSW", "IVCSW");
     }
-    int z;
-    unsigned long h;
-    char stat;
-    double time_from_boot;
-    int efb;
-
-    fscanf(file, "%d %s %c %d %d %d %d %d %u %lu %lu %lu %lu %lu %lu %d %d %d %d %d %d %d", &pid_get, cmd, &stat, &z, &z, &z, &z, &z,
-           (unsigned *)&z, &h, &h, &h, &h, &ut, &st, &z, &z, &z, &z, &z, &z, &efb);
-    fclose(file);
-    cmd[strlen(cmd) - 1] = 0;
-    double utime = ut*1.0f/sysconf(_SC_CLK_TCK);
-    double stime = st*1.0f/sysconf(_SC_CLK_TCK);
-    double exec_from_boot = efb*1.0f/sysconf(_SC_CLK_TCK);
-
-    FILE *uptime = fopen("/proc/uptime", "r");
-    if (uptime == NULL) {
-	    return;
-    }
-    fscanf(uptime, "%lf", &time_from_boot);
-    fclose(uptime);
-    double runtime=time_from_boot-exec_from_boot;
-    runtime=runtime<0?0:runtime;
-
-    printf("\n");
-    fflush(stdout);
-    printf("%-10s%-15s%-10s%-10s%-10s\n", "PID", "CMD", "RTIME", "UTIME", "STIME");
-    fflush(stdout);
-    printf("%-10d%-15s%-4.2lf%-6s%-4.2lf%-6s%-4.2lf%-6s\n", pid_get, cmd+1,runtime, " s", utime," s", stime," s");
+    printf("%-10d%-15.14s%-13s%-13s%-13s%-12s%-10ld%-10ld%-10ld%-10ld\n", pid, name, rtime, utime, stime, maxrss,
+           usage->ru_minflt, usage->ru_majflt, usage->ru_nvcsw, usage->ru_nivcsw);
     fflush(stdout);
 }
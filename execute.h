@@ -1,6 +1,9 @@
 #ifndef EXECUTE_H
 #define EXECUTE_H
 #include "util.h"
+#include "jobs.h"
+#include <sys/resource.h>
 void execute(Line *line);
-void print_timeX(int pid);
+pid_t run_command(Command *cmd, int in, int out, Job *job);
+void print_timeX(pid_t pid, const char *name, double runtime, const struct rusage *usage, bool header);
 #endif
\ No newline at end of file
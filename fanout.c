@@ -0,0 +1,179 @@
+#define _GNU_SOURCE
+#include "fanout.h"
+#include "util.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+/*
+    A fan-out of k sinks is a chain of k links. Link i reads from
+    stage[i]: stage[0] is the producer's pipe and stage[i] (i > 0) is
+    an internal pipe fed by link i-1. Every link but the last tee(2)s
+    its input into sink[i] and then splice(2)s exactly the same number
+    of bytes ("owed") into the next stage, so each sink sees the whole
+    stream in order. The last link splices straight into its sink.
+    The data only ever moves between kernel pipe buffers.
+*/
+typedef struct Link {
+    int in;      // read end of stage[i]
+    int out;     // write end of stage[i+1], -1 for the last link
+    int sink;    // write end of the consumer's pipe
+    size_t owed; // bytes tee'd into sink but not yet moved to out
+    bool dead;   // the consumer has gone away
+    bool done;
+} Link;
+
+/*
+    close the outputs of a link once its input is exhausted, so the
+    consumer and the next link see end of file.
+*/
+void finish_link(Link *link) {
+    link->done = true;
+    if (link->sink != -1) {
+        close(link->sink);
+        link->sink = -1;
+    }
+    if (link->out != -1) {
+        close(link->out);
+        link->out = -1;
+    }
+}
+
+/*
+    Moves data through one link without blocking. It returns the
+    number of bytes moved, 0 when the link cannot progress now and
+    sets the link done once its input reached end of file.
+    blocked_out is set when the link waits on its output.
+*/
+ssize_t step_link(Link *link, int devnull, bool *blocked_out) {
+    unsigned int flags = SPLICE_F_NONBLOCK | SPLICE_F_MOVE;
+    ssize_t moved;
+    *blocked_out = false;
+    if (link->out == -1) { // last link
+        int dst = link->dead ? devnull : link->sink;
+        moved = splice(link->in, NULL, dst, NULL, FANOUT_CHUNK, flags);
+    } else if (link->owed > 0) {
+        moved = splice(link->in, NULL, link->out, NULL, link->owed, flags);
+        if (moved > 0) {
+            link->owed -= moved;
+        }
+    } else if (link->dead) {
+        moved = splice(link->in, NULL, link->out, NULL, FANOUT_CHUNK, flags);
+    } else {
+        moved = tee(link->in, link->sink, FANOUT_CHUNK, SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            link->owed = moved;
+        }
+    }
+    if (moved == 0) {
+        finish_link(link);
+        return 0;
+    }
+    if (moved > 0) {
+        return moved;
+    }
+    if (errno == EPIPE && !link->dead && link->owed == 0) {
+        link->dead = true;
+        close(link->sink);
+        link->sink = -1;
+        return 0;
+    }
+    if (errno == EAGAIN) {
+        int pending = 0;
+        ioctl(link->in, FIONREAD, &pending);
+        *blocked_out = pending > 0;
+    } else if (errno != EINTR) {
+        finish_link(link);
+    }
+    return 0;
+}
+
+/*
+    fanOut copies everything readable from source into every fd of
+    sinks with tee(2)/splice(2) and returns at end of file or once
+    every consumer has gone away. It owns all the fds passed to it
+    and closes them. SIGPIPE is ignored while it runs so that a
+    consumer exiting early only drops that consumer.
+*/
+void fanOut(int source, int *sinks, int sink_number) {
+    struct sigaction ignore, old_pipe;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &old_pipe);
+
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    Link *links = (Link *)calloc(sink_number, sizeof(Link));
+    struct pollfd *fds = (struct pollfd *)malloc(sizeof(struct pollfd) * (sink_number + 1));
+    int in = source;
+    for (int i = 0; i < sink_number; i++) {
+        links[i].in = in;
+        links[i].sink = sinks[i];
+        links[i].out = -1;
+        if (i + 1 < sink_number) {
+            int stage[2];
+            if (pipe2(stage, O_CLOEXEC) == 0) {
+                fcntl(stage[1], F_SETPIPE_SZ, FANOUT_CHUNK * 16);
+                links[i].out = stage[1];
+                in = stage[0];
+            }
+        }
+    }
+
+    while (true) {
+        bool progress = false;
+        bool finished = true;
+        int nfds = 0;
+        for (int i = sink_number - 1; i >= 0; i--) { // downstream first frees room
+            Link *link = &links[i];
+            if (link->done) {
+                continue;
+            }
+            bool blocked_out;
+            if (step_link(link, devnull, &blocked_out) > 0 || link->done) {
+                progress = true;
+            }
+            if (link->done) {
+                continue;
+            }
+            finished = false;
+            if (blocked_out && link->sink != -1 && (link->out == -1 || link->owed == 0)) {
+                fds[nfds].fd = link->sink;
+                fds[nfds].events = POLLOUT;
+                ++nfds;
+            } else if (!blocked_out && i == 0) {
+                fds[nfds].fd = link->in;
+                fds[nfds].events = POLLIN;
+                ++nfds;
+            }
+        }
+        if (finished) {
+            break;
+        }
+        bool alive = false;
+        for (int i = 0; i < sink_number; i++) {
+            alive = alive || !links[i].dead;
+        }
+        if (!alive) {
+            break;
+        }
+        if (!progress && nfds > 0) {
+            poll(fds, nfds, -1);
+        }
+    }
+
+    for (int i = 0; i < sink_number; i++) {
+        finish_link(&links[i]);
+        close(links[i].in);
+    }
+    if (devnull != -1) {
+        close(devnull);
+    }
+    free(fds);
+    free(links);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+}
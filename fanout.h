@@ -0,0 +1,5 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+#define FANOUT_CHUNK (1 << 16)
+void fanOut(int source, int *sinks, int sink_number);
+#endif //FANOUT_H
@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include "history.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define HISTORY_QUERY_TRIGRAMS 256
+
+static History history={.fd=-1};
+
+/*
+    shellHistory returns the history of this shell, opened by main().
+*/
+History * shellHistory() {
+    return &history;
+}
+
+void resetIndex(History * history) {
+    history->blockNumber=0;
+    history->indexed=0;
+    history->counted=0;
+    history->count=0;
+}
+
+/*
+    openHistory opens the history file at path, creating it if
+    needed, and maps it. It returns false if the file cannot be
+    opened; the history is then empty and addHistory does nothing.
+*/
+bool openHistory(History * history, const char * path) {
+    history->map=nullptr;
+    history->size=0;
+    history->blocks=nullptr;
+    history->blockCapacity=0;
+    resetIndex(history);
+    history->fd=moveHigh(open(path,O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC,0600));
+    if (history->fd==-1) {
+        return false;
+    }
+    return refreshHistory(history);
+}
+
+void closeHistory(History * history) {
+    if (history->map!=nullptr) {
+        munmap(history->map,history->size);
+    }
+    if (history->fd!=-1) {
+        close(history->fd);
+    }
+    free(history->blocks);
+    history->fd=-1;
+    history->map=nullptr;
+    history->size=0;
+    history->blocks=nullptr;
+    history->blockCapacity=0;
+    resetIndex(history);
+}
+
+/*
+    refreshHistory maps the file again if its size has changed,
+    i.e. if this or another shell appended to it. The index is kept
+    unless the file shrank.
+*/
+bool refreshHistory(History * history) {
+    struct stat status;
+    if (history->fd==-1||fstat(history->fd,&status)==-1) {
+        return false;
+    }
+    size_t size=(size_t)status.st_size;
+    if (size==history->size) {
+        return true;
+    }
+    if (history->map!=nullptr) {
+        munmap(history->map,history->size);
+        history->map=nullptr;
+    }
+    if (size<history->size) {
+        resetIndex(history);
+    }
+    history->size=0;
+    if (size!=0) {
+        char * map=(char*)mmap(nullptr,size,PROT_READ,MAP_SHARED,history->fd,0);
+        if (map==MAP_FAILED) {
+            resetIndex(history);
+            return false;
+        }
+        history->map=map;
+        history->size=size;
+    }
+    return true;
+}
+
+/*
+    returns the end of the last complete entry, so that a line
+    another shell is still writing is left out.
+*/
+size_t entriesEnd(History * history) {
+    if (history->map==nullptr) {
+        return 0;
+    }
+    char * newline=(char*)memrchr(history->map,'\n',history->size);
+    return newline==nullptr?0:newline-history->map+1;
+}
+
+/*
+    addHistory appends line to the file with a single write(), so
+    that lines of concurrent shells do not interleave. Blank lines
+    and a repetition of the last entry are not recorded.
+*/
+void addHistory(History * history, const char * line) {
+    if (history->fd==-1||line[strspn(line," \t")]=='\0') {
+        return;
+    }
+    size_t length=strlen(line);
+    size_t lastLength=0;
+    ssize_t last=searchHistory(history,"",SIZE_MAX,&lastLength);
+    if (last!=-1&&lastLength==length&&memcmp(history->map+last,line,length)==0) {
+        return;
+    }
+    char * entry=(char*)malloc(length+1);
+    memcpy(entry,line,length);
+    entry[length]='\n';
+    if (write(history->fd,entry,length+1)==-1) {
+        perror("myshell: history");
+    }
+    free(entry);
+}
+
+/*
+    the hash of a trigram, i.e. its bit in a block filter.
+*/
+unsigned trigramHash(const char * text) {
+    uint32_t key=(uint32_t)(unsigned char)text[0]<<16|(uint32_t)(unsigned char)text[1]<<8|(unsigned char)text[2];
+    uint32_t hash=key*2654435761u;
+    return (hash>>16^hash)&(HISTORY_FILTER_BITS-1);
+}
+
+/*
+    indexHistory adds the entries after indexed to the blocks. A new
+    block is started once the last one covers HISTORY_BLOCK bytes, so
+    appending one entry only touches the last block.
+*/
+void indexHistory(History * history) {
+    size_t end=entriesEnd(history);
+    while (history->indexed<end) {
+        HistoryBlock * block=history->blockNumber==0?nullptr:&history->blocks[history->blockNumber-1];
+        if (block==nullptr||block->end-block->begin>=HISTORY_BLOCK) {
+            if (history->blockNumber==history->blockCapacity) {
+                history->blockCapacity=history->blockCapacity==0?64:history->blockCapacity*2;
+                history->blocks=(HistoryBlock*)realloc(history->blocks,sizeof(HistoryBlock)*history->blockCapacity);
+            }
+            block=&history->blocks[history->blockNumber++];
+            block->begin=history->indexed;
+            block->end=history->indexed;
+            memset(block->filter,0,sizeof(block->filter));
+        }
+        const char * entry=history->map+history->indexed;
+        const char * newline=(const char*)memchr(entry,'\n',end-history->indexed);
+        const char * p=entry;
+        for (p=entry;p+2<newline;++p) {
+            unsigned bit=trigramHash(p);
+            block->filter[bit/64]|=1ULL<<(bit%64);
+        }
+        history->indexed=newline-history->map+1;
+        block->end=history->indexed;
+    }
+}
+
+/*
+    searchHistory returns the offset of the newest entry that starts
+    before the offset before and contains query, and stores its
+    length into length; or -1 if there is none. An empty query
+    matches the entry just before, without the index. Otherwise only
+    the blocks whose filter has every trigram of the query are
+    scanned, newest first.
+*/
+ssize_t searchHistory(History * history, const char * query, size_t before, size_t * length) {
+    refreshHistory(history);
+    size_t queryLength=strlen(query);
+    if (queryLength==0) {
+        size_t end=entriesEnd(history);
+        before=before<end?before:end;
+        if (before==0) {
+            return -1;
+        }
+        char * newline=(char*)memrchr(history->map,'\n',before-1);
+        size_t start=newline==nullptr?0:newline-history->map+1;
+        *length=before-1-start;
+        return start;
+    }
+    indexHistory(history);
+    before=before<history->indexed?before:history->indexed;
+    unsigned bits[HISTORY_QUERY_TRIGRAMS];
+    size_t bitNumber=0;
+    size_t i=0;
+    for (i=0;i+2<queryLength&&bitNumber!=HISTORY_QUERY_TRIGRAMS;++i) {
+        bits[bitNumber++]=trigramHash(query+i);
+    }
+    size_t b=history->blockNumber;
+    while (b--!=0) {
+        HistoryBlock * block=&history->blocks[b];
+        if (block->begin>=before) {
+            continue;
+        }
+        bool candidate=true;
+        for (i=0;i!=bitNumber&&candidate;++i) {
+            candidate=(block->filter[bits[i]/64]>>(bits[i]%64))&1;
+        }
+        if (!candidate) {
+            continue;
+        }
+        char * begin=history->map+block->begin;
+        char * limit=history->map+(block->end<before?block->end:before);
+        char * p=begin;
+        char * last=nullptr;
+        char * hit=nullptr;
+        // the query has no newline, so a hit lies within one entry.
+        while ((hit=(char*)memmem(p,limit-p,query,queryLength))!=nullptr) {
+            last=hit;
+            p=(char*)memchr(hit,'\n',limit-hit)+1;
+        }
+        if (last!=nullptr) {
+            char * newline=(char*)memrchr(begin,'\n',last-begin);
+            char * start=newline==nullptr?begin:newline+1;
+            *length=(char*)memchr(last,'\n',limit-last)-start;
+            return start-history->map;
+        }
+    }
+    return -1;
+}
+
+/*
+    nextHistory returns the entry that starts at the offset after,
+    the end of a previous entry, or -1 if after is past the last one.
+*/
+ssize_t nextHistory(History * history, size_t after, size_t * length) {
+    size_t end=entriesEnd(history);
+    if (after>=end) {
+        return -1;
+    }
+    char * newline=(char*)memchr(history->map+after,'\n',end-after);
+    *length=newline-(history->map+after);
+    return after;
+}
+
+/*
+    historyBuiltin runs "history [n]": it prints the last n entries,
+    or all of them, numbered from the first entry of the file.
+*/
+void historyBuiltin(int argc, char ** argv) {
+    size_t number=SIZE_MAX;
+    if (argc>2||(argc==2&&(argv[1][0]<'0'||argv[1][0]>'9'))) {
+        fprintf(stderr,"myshell: history: usage: history [n]\n");
+        return;
+    }
+    if (argc==2) {
+        number=strtoul(argv[1],nullptr,10);
+    }
+    refreshHistory(&history);
+    size_t end=entriesEnd(&history);
+    while (history.counted<end) {
+        char * newline=(char*)memchr(history.map+history.counted,'\n',end-history.counted);
+        history.counted=newline-history.map+1;
+        ++history.count;
+    }
+    number=number<history.count?number:history.count;
+    // walk back number entries from the end.
+    size_t start=end;
+    size_t i=0;
+    for (i=0;i!=number;++i) {
+        char * newline=start<2?nullptr:(char*)memrchr(history.map,'\n',start-1);
+        start=newline==nullptr?0:newline-history.map+1;
+    }
+    TextBuffer text;
+    initText(&text);
+    size_t index=history.count-number+1;
+    while (start<end) {
+        char * newline=(char*)memchr(history.map+start,'\n',end-start);
+        appendFormat(&text,"%5zu  ",index++);
+        appendText(&text,history.map+start,newline-(history.map+start)+1);
+        start=newline-history.map+1;
+        if (text.size>=HISTORY_BLOCK*16) {
+            writeText(STDOUT_FILENO,&text);
+            text.size=0;
+        }
+    }
+    writeText(STDOUT_FILENO,&text);
+    freeText(&text);
+}
@@ -0,0 +1,52 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#include "util.h"
+#include <stdint.h>
+
+#define HISTORY_FILE ".myshell_history"
+#define HISTORY_BLOCK 4096
+#define HISTORY_FILTER_BITS 8192
+#define HISTORY_FILTER_WORDS (HISTORY_FILTER_BITS/64)
+
+/*
+    A HistoryBlock covers the entries of the history file in
+    [begin, end), about HISTORY_BLOCK bytes of whole lines. filter has
+    the bit of the hash of every trigram of those entries set, so a
+    search can skip a block when a trigram of the query is missing.
+*/
+typedef struct HistoryBlock {
+    size_t begin;
+    size_t end;
+    uint64_t filter[HISTORY_FILTER_WORDS];
+} HistoryBlock;
+
+/*
+    History is the append-only history file, one command per line,
+    mapped read-only in map[0, size). Every shell appends with
+    O_APPEND and re-maps when the file has grown, so sessions see
+    each other's commands. Nothing is parsed when the file is
+    opened: the blocks are built on the first search up to indexed,
+    and entries are counted for "history" up to counted.
+*/
+typedef struct History {
+    int fd;
+    char * map;
+    size_t size;
+    HistoryBlock * blocks;
+    size_t blockNumber;
+    size_t blockCapacity;
+    size_t indexed;
+    size_t counted;
+    size_t count;
+} History;
+
+History * shellHistory();
+bool openHistory(History * history, const char * path);
+void closeHistory(History * history);
+bool refreshHistory(History * history);
+void addHistory(History * history, const char * line);
+void indexHistory(History * history);
+ssize_t searchHistory(History * history, const char * query, size_t before, size_t * length);
+ssize_t nextHistory(History * history, size_t after, size_t * length);
+void historyBuiltin(int argc, char ** argv);
+#endif //HISTORY_H
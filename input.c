@@ -0,0 +1,108 @@
+#include "input.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+static LineReader * interactive=nullptr;
+
+void initReader(LineReader * reader, int fd) {
+    reader->fd=fd;
+    reader->capacity=READER_CHUNK;
+    reader->buffer=(char*)malloc(reader->capacity);
+    reader->size=0;
+    reader->position=0;
+    reader->eof=false;
+}
+
+/*
+    It creates a reader over input, used by "myshell -c".
+*/
+void initStringReader(LineReader * reader, const char * input) {
+    size_t size=strlen(input);
+    reader->fd=-1;
+    reader->capacity=size+1;
+    reader->buffer=(char*)malloc(reader->capacity);
+    memcpy(reader->buffer,input,size);
+    reader->size=size;
+    reader->position=0;
+    reader->eof=true;
+}
+
+/*
+    It returns the next complete line without its newline, terminated
+    in place in the buffer, so it stays valid until the next call.
+    At end of input the last unterminated line is returned too.
+    It returns nullptr if no complete line is buffered.
+*/
+char * takeLine(LineReader * reader) {
+    char * begin=reader->buffer+reader->position;
+    size_t pending=reader->size-reader->position;
+    char * newline=(char*)memchr(begin,'\n',pending);
+    if (newline!=nullptr) {
+        *newline='\0';
+        reader->position+=newline-begin+1;
+        return begin;
+    }
+    if (reader->eof&&pending!=0) {
+        begin[pending]='\0';
+        reader->position=reader->size;
+        return begin;
+    }
+    return nullptr;
+}
+
+/*
+    fillReader appends the result of one read() to the buffer.
+    Lines may be of any length: the buffer doubles when a line does
+    not fit. It returns false if read() was interrupted by a signal;
+    reader->eof is set at end of input.
+*/
+bool fillReader(LineReader * reader) {
+    if (reader->eof) {
+        return true;
+    }
+    size_t pending=reader->size-reader->position;
+    if (reader->position!=0) {
+        memmove(reader->buffer,reader->buffer+reader->position,pending);
+        reader->position=0;
+        reader->size=pending;
+    }
+    if (reader->capacity-reader->size<READER_CHUNK/2) {
+        reader->capacity*=2;
+        reader->buffer=(char*)realloc(reader->buffer,reader->capacity);
+    }
+    ssize_t readSize=read(reader->fd,reader->buffer+reader->size,reader->capacity-reader->size-1);
+    if (readSize>0) {
+        reader->size+=readSize;
+    } else if (readSize==-1&&errno==EINTR) {
+        return false;
+    } else {
+        reader->eof=true;
+    }
+    return true;
+}
+
+void freeReader(LineReader * reader) {
+    free(reader->buffer);
+    if (reader->fd>STDERR_FILENO) {
+        close(reader->fd);
+    }
+}
+
+/*
+    setInteractiveReader records the reader of an interactive shell,
+    so that a built-in waiting on the terminal, like "viewtree
+    --watch", takes its input through it.
+*/
+void setInteractiveReader(LineReader * reader) {
+    interactive=reader;
+}
+
+/*
+    interactiveReader returns the reader of the terminal, or nullptr
+    when the shell runs a script or reads a pipe.
+*/
+LineReader * interactiveReader() {
+    return interactive;
+}
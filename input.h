@@ -0,0 +1,29 @@
+#ifndef INPUT_H
+#define INPUT_H
+#include "util.h"
+
+#define READER_CHUNK (1 << 20)
+
+/*
+    LineReader hands out the lines of fd one at a time from a
+    large buffer which it refills with a single read() per chunk.
+    takeLine() never reads, so the caller decides when to block.
+    Unread bytes live in buffer[position, size).
+*/
+typedef struct LineReader {
+    int fd;
+    char * buffer;
+    size_t size;
+    size_t capacity;
+    size_t position;
+    bool eof;
+} LineReader;
+
+void initReader(LineReader * reader, int fd);
+void initStringReader(LineReader * reader, const char * input);
+char * takeLine(LineReader * reader);
+bool fillReader(LineReader * reader);
+void freeReader(LineReader * reader);
+void setInteractiveReader(LineReader * reader);
+LineReader * interactiveReader();
+#endif //INPUT_H
@@ -0,0 +1,525 @@
+#include "jobs.h"
+#include "execute.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <wait.h>
+#include <sys/resource.h>
+
+/*
+    PidNode maps a pid to its Job in pid_index, a chained hash table
+    which doubles when it holds twice as many pids as buckets, so
+    finding the job of a reaped pid is O(1).
+*/
+typedef struct PidNode {
+    pid_t pid;
+    Job *job;
+    struct PidNode *next;
+} PidNode;
+
+static PidNode **pid_index = NULL;
+static int pid_buckets = 0;
+static int pid_count = 0;
+
+/*
+    job_table[id] is the job with that id; ids are handed out as one
+    more than the largest id in use, like in bash.
+*/
+static Job **job_table = NULL;
+static int job_capacity = 0;
+static int max_job_id = 0;
+
+/*
+    running_background counts background jobs which are running, and
+    completed_background counts background jobs that have finished,
+    which is what "wait" and "wait -n" wait on.
+*/
+static int running_background = 0;
+static unsigned long completed_background = 0;
+
+/*
+    reports counts the Done and Stopped messages printed for
+    background jobs, so the main loop knows when to print a new
+    prompt.
+*/
+static unsigned long reports = 0;
+
+/*
+    status_of_last is the wait status of the last stage of the last
+    foreground job that finished, or of a built-in run in the shell.
+*/
+static int status_of_last = 0;
+
+static int shell_terminal = -1;
+static pid_t shell_pgid = 0;
+
+/*
+    init_job_control puts an interactive shell into its own process
+    group, takes the terminal and ignores the job control signals so
+    that only foreground jobs are stopped by Ctrl-Z.
+*/
+void init_job_control(int interactive) {
+    pid_buckets = 64;
+    pid_index = (PidNode **)calloc(pid_buckets, sizeof(PidNode *));
+    job_capacity = 16;
+    job_table = (Job **)calloc(job_capacity, sizeof(Job *));
+    if (!interactive || !isatty(STDIN_FILENO)) {
+        return;
+    }
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    shell_pgid = getpid();
+    if (setpgid(0, shell_pgid) == -1) {
+        shell_pgid = getpgrp();
+    }
+    shell_terminal = STDIN_FILENO;
+    tcsetpgrp(shell_terminal, shell_pgid);
+}
+
+int last_status() {
+    return status_of_last;
+}
+
+void set_last_status(int status) {
+    status_of_last = status;
+}
+
+unsigned long job_reports() {
+    return reports;
+}
+
+/*
+    tells whether the job table and the pid index are both empty, i.e.
+    every job has been reaped and freed.
+*/
+bool jobs_empty() {
+    return max_job_id == 0 && pid_count == 0;
+}
+
+/*
+    returns the terminal a foreground job should be given, or -1
+    when the shell does not do job control.
+*/
+int terminal_fd() {
+    return shell_terminal;
+}
+
+void index_grow() {
+    int buckets = pid_buckets * 2;
+    PidNode **index = (PidNode **)calloc(buckets, sizeof(PidNode *));
+    for (int i = 0; i < pid_buckets; i++) {
+        PidNode *node = pid_index[i];
+        while (node != NULL) {
+            PidNode *next = node->next;
+            node->next = index[node->pid % buckets];
+            index[node->pid % buckets] = node;
+            node = next;
+        }
+    }
+    free(pid_index);
+    pid_index = index;
+    pid_buckets = buckets;
+}
+
+void index_insert(pid_t pid, Job *job) {
+    if (pid_count >= pid_buckets * 2) {
+        index_grow();
+    }
+    PidNode *node = (PidNode *)malloc(sizeof(PidNode));
+    node->pid = pid;
+    node->job = job;
+    node->next = pid_index[pid % pid_buckets];
+    pid_index[pid % pid_buckets] = node;
+    ++pid_count;
+}
+
+Job *index_find(pid_t pid) {
+    PidNode *node = pid_index[pid % pid_buckets];
+    while (node != NULL && node->pid != pid) {
+        node = node->next;
+    }
+    return node != NULL ? node->job : NULL;
+}
+
+void index_remove(pid_t pid) {
+    PidNode **iterator = &pid_index[pid % pid_buckets];
+    while (*iterator != NULL && (*iterator)->pid != pid) {
+        iterator = &(*iterator)->next;
+    }
+    if (*iterator != NULL) {
+        PidNode *node = *iterator;
+        *iterator = node->next;
+        free(node);
+        --pid_count;
+    }
+}
+
+/*
+    create_job allocates a job for command with the next free id.
+*/
+Job *create_job(const char *command, int background, int timed) {
+    int id = max_job_id + 1;
+    if (id >= job_capacity) {
+        job_table = (Job **)realloc(job_table, sizeof(Job *) * job_capacity * 2);
+        memset(job_table + job_capacity, 0, sizeof(Job *) * job_capacity);
+        job_capacity *= 2;
+    }
+    Job *job = (Job *)malloc(sizeof(Job));
+    job->id = id;
+    job->pgid = 0;
+    job->capacity = 4;
+    job->pids = (pid_t *)malloc(sizeof(pid_t) * job->capacity);
+    job->names = NULL;
+    job->started = NULL;
+    job->events = NULL;
+    job->counters = NULL;
+    job->limits = NULL;
+    job->cgroup = NULL;
+    job->spread = -1;
+    if (timed) {
+        job->names = (char **)malloc(sizeof(char *) * job->capacity);
+        job->started = (struct timespec *)malloc(sizeof(struct timespec) * job->capacity);
+    }
+    job->process_number = 0;
+    job->alive = 0;
+    job->state = JOB_RUNNING;
+    job->background = background;
+    job->timed = timed;
+    job->reported = 0;
+    job->status = 0;
+    job->command = strdup(command);
+    if (background) {
+        ++running_background;
+    }
+    job_table[id] = job;
+    max_job_id = id;
+    return job;
+}
+
+/*
+    add_process records a process spawned for job; the first one
+    becomes the leader of the job's process group. name and started,
+    the time taken just before the spawn, are only kept for a timed job,
+    and counters only when it counts events.
+*/
+void add_process(Job *job, pid_t pid, const char *name, const struct timespec *started, const PerfCounters *counters) {
+    if (job->process_number == job->capacity) {
+        job->capacity *= 2;
+        job->pids = (pid_t *)realloc(job->pids, sizeof(pid_t) * job->capacity);
+        if (job->timed) {
+            job->names = (char **)realloc(job->names, sizeof(char *) * job->capacity);
+            job->started = (struct timespec *)realloc(job->started, sizeof(struct timespec) * job->capacity);
+        }
+        if (job->counters != NULL) {
+            job->counters = (PerfCounters *)realloc(job->counters, sizeof(PerfCounters) * job->capacity);
+        }
+    }
+    if (job->events != NULL && job->counters == NULL) {
+        job->counters = (PerfCounters *)malloc(sizeof(PerfCounters) * job->capacity);
+    }
+    if (job->counters != NULL && counters != NULL) {
+        job->counters[job->process_number] = *counters;
+    } else if (job->counters != NULL) {
+        job->counters[job->process_number].number = 0;
+    }
+    if (job->timed) {
+        const char *base = strrchr(name, '/');
+        job->names[job->process_number] = strdup(base != NULL ? base + 1 : name);
+        job->started[job->process_number] = *started;
+    }
+    job->pids[job->process_number++] = pid;
+    ++job->alive;
+    if (job->pgid == 0) {
+        job->pgid = pid;
+    }
+    index_insert(pid, job);
+}
+
+/*
+    set_job moves job to state and to the foreground or background,
+    keeping running_background up to date.
+*/
+void set_job(Job *job, int state, int background) {
+    if (job->background && job->state == JOB_RUNNING) {
+        --running_background;
+    }
+    job->state = state;
+    job->background = background;
+    if (job->background && job->state == JOB_RUNNING) {
+        ++running_background;
+    }
+}
+
+void free_job(Job *job) {
+    set_job(job, JOB_DONE, job->background);
+    for (int i = 0; i < job->process_number; i++) {
+        index_remove(job->pids[i]);
+    }
+    job_table[job->id] = NULL;
+    while (max_job_id > 0 && job_table[max_job_id] == NULL) {
+        --max_job_id;
+    }
+    if (job->timed) {
+        for (int i = 0; i < job->process_number; i++) {
+            free(job->names[i]);
+        }
+        free(job->names);
+        free(job->started);
+    }
+    if (job->counters != NULL) {
+        for (int i = 0; i < job->process_number; i++) {
+            closeCounters(&job->counters[i]);
+        }
+        free(job->counters);
+    }
+    if (job->cgroup != NULL) {
+        if (job->process_number > 0) {
+            reportCgroup(job->cgroup, job->id);
+        }
+        removeCgroup(job->cgroup);
+    }
+    free(job->limits);
+    free(job->events);
+    free(job->pids);
+    free(job->command);
+    free(job);
+}
+
+/*
+    update_job applies the wait status and resource usage of pid to its
+    job. An exiting process of a timed job is reported by print_timeX().
+    A finished background job is reported as Done and freed; a
+    foreground job is left to wait_job().
+*/
+void update_job(pid_t pid, int status, const struct rusage *usage) {
+    Job *job = index_find(pid);
+    if (job == NULL) {
+        return;
+    }
+    if (WIFSTOPPED(status)) {
+        if (job->state == JOB_RUNNING && job->background) {
+            ++reports;
+            printf("[%d] Stopped\t%s\n", job->id, job->command);
+            fflush(stdout);
+        }
+        set_job(job, JOB_STOPPED, job->background);
+        return;
+    }
+    if (WIFCONTINUED(status)) {
+        set_job(job, JOB_RUNNING, job->background);
+        return;
+    }
+    if (job->timed) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int i = job->process_number - 1;
+        while (i > 0 && job->pids[i] != pid) {
+            --i;
+        }
+        double runtime = (now.tv_sec - job->started[i].tv_sec) + (now.tv_nsec - job->started[i].tv_nsec) / 1e9;
+        print_timeX(pid, job->names[i], runtime, usage, !job->reported);
+        if (job->counters != NULL) {
+            printCounters(job->events, &job->counters[i]);
+            closeCounters(&job->counters[i]);
+        }
+        job->reported = 1;
+    }
+    index_remove(pid);
+    --job->alive;
+    if (pid == job->pids[job->process_number - 1]) {
+        job->status = status;
+    }
+    if (job->alive > 0) {
+        return;
+    }
+    if (job->background) {
+        ++completed_background;
+        ++reports;
+        printf("[%d] Done\t%s\n", job->id, job->command);
+        fflush(stdout);
+        free_job(job);
+    } else {
+        job->state = JOB_DONE;
+    }
+}
+
+/*
+    reap_child waits for pid (-1 for any child) with one wait4() and
+    updates the job table. The wait status is stored into status
+    unless it is NULL. It returns what wait4() returned.
+*/
+pid_t reap_child(pid_t pid, int options, int *status) {
+    int result_status;
+    struct rusage usage;
+    pid_t result = wait4(pid, &result_status, options | WUNTRACED | WCONTINUED, &usage);
+    if (result > 0) {
+        update_job(result, result_status, &usage);
+        if (status != NULL) {
+            *status = result_status;
+        }
+    }
+    return result;
+}
+
+/*
+    wait_job gives the terminal to a foreground job and reaps until
+    every process of it has exited or it is stopped. The shell ignores
+    SIGINT while it waits. A stopped job stays in the table, a finished
+    one is freed.
+*/
+void wait_job(Job *job) {
+    if (shell_terminal != -1) {
+        tcsetpgrp(shell_terminal, job->pgid);
+    }
+    struct sigaction act;
+    sigaction(SIGINT, NULL, &act);
+    signal(SIGINT, SIG_IGN);
+    while (job->state == JOB_RUNNING && job->alive > 0) {
+        if (reap_child(-1, 0, NULL) == -1 && errno != EINTR) {
+            break;
+        }
+    }
+    sigaction(SIGINT, &act, NULL);
+    if (shell_terminal != -1) {
+        tcsetpgrp(shell_terminal, shell_pgid);
+    }
+    if (job->state == JOB_STOPPED) {
+        printf("\n[%d] Stopped\t%s\n", job->id, job->command);
+        fflush(stdout);
+    } else {
+        status_of_last = job->status;
+        free_job(job);
+    }
+}
+
+/*
+    start_job is called once every process of job has been spawned.
+    A foreground job is waited for; a background one is announced
+    with its id and process group in an interactive shell.
+*/
+void start_job(Job *job) {
+    if (job->alive == 0) {
+        free_job(job);
+    } else if (!job->background) {
+        wait_job(job);
+    } else {
+        if (shell_terminal != -1) {
+            printf("[%d] %d\n", job->id, job->pgid);
+            fflush(stdout);
+        }
+    }
+}
+
+/*
+    find_job returns the job named by arg ("3" or "%3"), or the most
+    recent job (the most recent stopped one if stopped_only is set)
+    when arg is NULL. It prints an error for the builtin name and
+    returns NULL if there is none.
+*/
+Job *find_job(const char *name, const char *arg, int stopped_only) {
+    if (arg == NULL) {
+        for (int id = max_job_id; id > 0; id--) {
+            if (job_table[id] != NULL && (!stopped_only || job_table[id]->state == JOB_STOPPED)) {
+                return job_table[id];
+            }
+        }
+        fprintf(stderr, "myshell: %s: no current job\n", name);
+        return NULL;
+    }
+    const char *digits = arg[0] == '%' ? arg + 1 : arg;
+    char *end = NULL;
+    long id = strtol(digits, &end, 10);
+    if (*digits == '\0' || *end != '\0' || id <= 0 || id > max_job_id || job_table[id] == NULL) {
+        fprintf(stderr, "myshell: %s: %s: no such job\n", name, arg);
+        return NULL;
+    }
+    return job_table[id];
+}
+
+/*
+    jobs lists every job with its state.
+*/
+void jobs_builtin(int argc, char **argv) {
+    for (int id = 1; id <= max_job_id; id++) {
+        Job *job = job_table[id];
+        if (job != NULL) {
+            printf("[%d]  %-10s%s%s\n", id, job->state == JOB_STOPPED ? "Stopped" : "Running",
+                   job->command, job->background && job->state == JOB_RUNNING ? " &" : "");
+        }
+    }
+    fflush(stdout);
+}
+
+/*
+    fg continues a job in the foreground and waits for it.
+*/
+void fg_builtin(int argc, char **argv) {
+    Job *job = find_job("fg", argc > 1 ? argv[1] : NULL, 0);
+    if (job == NULL) {
+        return;
+    }
+    printf("%s\n", job->command);
+    fflush(stdout);
+    set_job(job, JOB_RUNNING, 0);
+    if (shell_terminal != -1) {
+        tcsetpgrp(shell_terminal, job->pgid);
+    }
+    kill(-job->pgid, SIGCONT);
+    wait_job(job);
+}
+
+/*
+    bg continues a stopped job in the background.
+*/
+void bg_builtin(int argc, char **argv) {
+    Job *job = find_job("bg", argc > 1 ? argv[1] : NULL, 1);
+    if (job == NULL) {
+        return;
+    }
+    set_job(job, JOB_RUNNING, 1);
+    kill(-job->pgid, SIGCONT);
+    printf("[%d] %s &\n", job->id, job->command);
+    fflush(stdout);
+}
+
+/*
+    "wait" waits for every running background job, "wait -n" for the
+    next one to finish and "wait id" for that job. Children are reaped
+    through the same wait4() path as everywhere else, so waiting costs
+    nothing while jobs run. SIGINT interrupts the wait.
+*/
+void wait_builtin(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-n") == 0) {
+        unsigned long target = completed_background + 1;
+        while (completed_background < target && running_background > 0) {
+            if (reap_child(-1, 0, NULL) == -1) {
+                break;
+            }
+        }
+        return;
+    }
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            Job *job = find_job("wait", argv[i], 0);
+            if (job == NULL) {
+                continue;
+            }
+            int id = job->id;
+            while (job_table[id] == job && job->state == JOB_RUNNING && job->background) {
+                if (reap_child(-1, 0, NULL) == -1) {
+                    return;
+                }
+            }
+        }
+        return;
+    }
+    while (running_background > 0) {
+        if (reap_child(-1, 0, NULL) == -1) {
+            break;
+        }
+    }
+}
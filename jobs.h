@@ -0,0 +1,61 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include "util.h"
+#include "perfevent.h"
+#include "limit.h"
+#include <sys/types.h>
+#include <time.h>
+
+#define JOB_RUNNING 0
+#define JOB_STOPPED 1
+#define JOB_DONE 2
+
+/*
+    A Job is one command line: all its processes share the process
+    group pgid. pids holds every process spawned for it and alive
+    counts those not reaped yet. status is the wait status of the
+    last stage. A timed job also keeps the name and the spawn time of
+    every process, so that it can be reported when it is reaped, and
+    with "timeX -e" the perf counters of every process for events.
+    A job run with "limit" keeps its limits and, when cgroup v2 could
+    be used, the transient cgroup all its processes move into. spread
+    is the index of its next process on the CPUs of @spread, or -1.
+*/
+typedef struct Job {
+    int id;
+    pid_t pgid;
+    pid_t *pids;
+    char **names;
+    struct timespec *started;
+    PerfEventSet *events;
+    PerfCounters *counters;
+    ResourceLimits *limits;
+    JobCgroup *cgroup;
+    int spread;
+    int process_number;
+    int capacity;
+    int alive;
+    int state;
+    int background;
+    int timed;
+    int reported;
+    int status;
+    char *command;
+} Job;
+
+void init_job_control(int interactive);
+Job *create_job(const char *command, int background, int timed);
+void add_process(Job *job, pid_t pid, const char *name, const struct timespec *started, const PerfCounters *counters);
+pid_t reap_child(pid_t pid, int options, int *status);
+void wait_job(Job *job);
+void start_job(Job *job);
+void jobs_builtin(int argc, char **argv);
+void fg_builtin(int argc, char **argv);
+void bg_builtin(int argc, char **argv);
+void wait_builtin(int argc, char **argv);
+int terminal_fd();
+unsigned long job_reports();
+bool jobs_empty();
+int last_status();
+void set_last_status(int status);
+#endif //JOBS_H
@@ -0,0 +1,478 @@
+#define _GNU_SOURCE
+#include "limit.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+    parseSize reads a number of bytes with an optional binary suffix,
+    K, M, G or T, into size. It returns false if text is not one.
+*/
+bool parseSize(const char * text, long long * size) {
+    char * end;
+    errno=0;
+    double value=strtod(text,&end);
+    if (errno!=0||end==text||value<=0) {
+        return false;
+    }
+    const char * suffixes="KMGT";
+    const char * suffix=*end=='\0'?nullptr:strchr(suffixes,*end&~0x20);
+    if (*end!='\0'&&suffix==nullptr) {
+        return false;
+    }
+    if (suffix!=nullptr) {
+        for (const char * i=suffixes;i<=suffix;++i) {
+            value*=1024;
+        }
+        ++end;
+    }
+    if (*end!='\0'||value>9.2e18) {
+        return false;
+    }
+    *size=(long long)value;
+    return true;
+}
+
+/*
+    parseCount reads a positive number of processes or files.
+*/
+bool parseCount(const char * text, long * count) {
+    char * end;
+    errno=0;
+    long value=strtol(text,&end,10);
+    if (errno!=0||end==text||*end!='\0'||value<=0) {
+        return false;
+    }
+    *count=value;
+    return true;
+}
+
+/*
+    parseLimits reads the options of "limit --mem 2G --cpu 1.5
+    --pids 100 --nofile 4096 command" into limits, each given either
+    as "--mem 2G" or as "--mem=2G", and leaves argc and argv at the
+    command. It prints the error and returns false if an option is
+    wrong or no command follows.
+*/
+bool parseLimits(int * argc, char *** argv, ResourceLimits * limits) {
+    limits->memory=-1;
+    limits->cpu=-1;
+    limits->pids=-1;
+    limits->files=-1;
+    int i=1;
+    for (;i<*argc&&strncmp((*argv)[i],"--",2)==0;++i) {
+        char * name=(*argv)[i]+2;
+        char * value=strchr(name,'=');
+        size_t length=value==nullptr?strlen(name):(size_t)(value-name);
+        if (value!=nullptr) {
+            ++value;
+        } else if (i+1<*argc) {
+            value=(*argv)[++i];
+        } else {
+            fprintf(stderr,"myshell: limit: --%s needs a value\n",name);
+            return false;
+        }
+        bool valid;
+        if (length==3&&strncmp(name,"mem",3)==0) {
+            valid=parseSize(value,&limits->memory);
+        } else if (length==3&&strncmp(name,"cpu",3)==0) {
+            char * end;
+            limits->cpu=strtod(value,&end);
+            valid=end!=value&&*end=='\0'&&limits->cpu>0;
+        } else if (length==4&&strncmp(name,"pids",4)==0) {
+            valid=parseCount(value,&limits->pids);
+        } else if (length==6&&strncmp(name,"nofile",6)==0) {
+            valid=parseCount(value,&limits->files);
+        } else {
+            fprintf(stderr,"myshell: limit: unknown option --%.*s\n",(int)length,name);
+            return false;
+        }
+        if (!valid) {
+            fprintf(stderr,"myshell: limit: invalid value \"%s\" for --%.*s\n",value,(int)length,name);
+            return false;
+        }
+    }
+    if (i==*argc) {
+        fprintf(stderr,"myshell: usage: limit [--mem size] [--cpu cpus] [--pids n] [--nofile n] command\n");
+        return false;
+    }
+    *argc-=i;
+    *argv+=i;
+    return true;
+}
+
+/*
+    spawnLimits fills result, of LIMIT_RESOURCES entries, with the
+    rlimits each process of a job sets before its exec and returns
+    their number. RLIMIT_NOFILE is always used. When the job has a
+    cgroup, memory.max and pids.max are exact, otherwise memory falls
+    back to RLIMIT_AS, which counts the address space rather than the
+    resident memory, and pids to RLIMIT_NPROC, which counts every
+    process of the user.
+*/
+int spawnLimits(const ResourceLimits * limits, bool cgroup, SpawnLimit * result) {
+    int number=0;
+    if (limits->files>0) {
+        result[number].resource=RLIMIT_NOFILE;
+        result[number].value.rlim_cur=result[number].value.rlim_max=limits->files;
+        ++number;
+    }
+    if (!cgroup&&limits->memory>0) {
+        result[number].resource=RLIMIT_AS;
+        result[number].value.rlim_cur=result[number].value.rlim_max=limits->memory;
+        ++number;
+    }
+    if (!cgroup&&limits->pids>0) {
+        result[number].resource=RLIMIT_NPROC;
+        result[number].value.rlim_cur=result[number].value.rlim_max=limits->pids;
+        ++number;
+    }
+    return number;
+}
+
+/*
+    writeControl writes value into the file name of the cgroup
+    directory path. It returns false if it could not.
+*/
+bool writeControl(const char * path, const char * name, const char * value) {
+    char file[PATH_MAX];
+    snprintf(file,sizeof(file),"%s/%s",path,name);
+    int fd=open(file,O_WRONLY|O_CLOEXEC);
+    if (fd==-1) {
+        return false;
+    }
+    ssize_t length=strlen(value);
+    bool result=write(fd,value,length)==length;
+    close(fd);
+    return result;
+}
+
+/*
+    readControl reads the file name of the cgroup directory path into
+    buffer, terminated by '\0'. It returns false if it could not.
+*/
+bool readControl(const char * path, const char * name, char * buffer, size_t size) {
+    char file[PATH_MAX];
+    snprintf(file,sizeof(file),"%s/%s",path,name);
+    int fd=open(file,O_RDONLY|O_CLOEXEC);
+    if (fd==-1) {
+        return false;
+    }
+    ssize_t length=read(fd,buffer,size-1);
+    close(fd);
+    if (length<0) {
+        return false;
+    }
+    buffer[length]='\0';
+    return true;
+}
+
+/*
+    hasController tells whether the space separated list holds name.
+*/
+bool hasController(const char * list, const char * name) {
+    size_t length=strlen(name);
+    for (const char * i=strstr(list,name);i!=nullptr;i=strstr(i+1,name)) {
+        if ((i==list||i[-1]==' ')&&(i[length]==' '||i[length]=='\n'||i[length]=='\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    shellCgroup finds the cgroup v2 directory of the shell: the mount
+    point of cgroup2 from /proc/self/mountinfo followed by the "0::"
+    path of /proc/self/cgroup. It returns false on a system without
+    cgroup v2.
+*/
+bool shellCgroup(char * path, size_t size) {
+    FILE * file=fopen("/proc/self/mountinfo","re");
+    if (file==nullptr) {
+        return false;
+    }
+    char * line=nullptr;
+    size_t capacity=0;
+    char mount[PATH_MAX]="";
+    while (getline(&line,&capacity,file)!=-1) {
+        char point[PATH_MAX];
+        char * separator=strstr(line," - ");
+        if (separator!=nullptr&&strncmp(separator+3,"cgroup2 ",8)==0&&sscanf(line,"%*s %*s %*s %*s %4095s",point)==1) {
+            strcpy(mount,point);
+            break;
+        }
+    }
+    fclose(file);
+    file=fopen("/proc/self/cgroup","re");
+    bool found=false;
+    while (mount[0]!='\0'&&file!=nullptr&&getline(&line,&capacity,file)!=-1) {
+        if (strncmp(line,"0::",3)==0) {
+            line[strcspn(line,"\n")]='\0';
+            found=snprintf(path,size,"%s%s",mount,strcmp(line+3,"/")==0?"":line+3)<(int)size;
+            break;
+        }
+    }
+    if (file!=nullptr) {
+        fclose(file);
+    }
+    free(line);
+    return found;
+}
+
+/*
+    shellParent is the cgroup "myshell-<pid>" that holds the leaf
+    "shell", into which the shell moves itself, and the cgroups of
+    its limited jobs beside it; shellOrigin is where the shell was
+    before. shellParent is empty until the first limited job.
+*/
+static char shellParent[PATH_MAX];
+static char shellOrigin[PATH_MAX];
+
+/*
+    shellEnabled holds the controllers, in the order of needed, that
+    the shell enabled in shellOrigin, to be disabled again before it
+    moves back: cgroup v2 accepts no process in a non-root cgroup
+    that has them enabled.
+*/
+static const char * shellEnabled[3];
+
+/*
+    enableControllers enables the controllers of needed, of 3 entries
+    of which unneeded ones are nullptr, in the subtree_control of the
+    cgroup path, if they are not enabled yet, and records those it
+    enabled in added unless it is nullptr. It returns false if one
+    is not available there or cannot be enabled.
+*/
+bool enableControllers(const char * path, const char * const * needed, const char ** added) {
+    char available[256];
+    char enabled[256];
+    if (!readControl(path,"cgroup.controllers",available,sizeof(available))) {
+        return false;
+    }
+    for (int i=0;i!=3;++i) {
+        if (needed[i]==nullptr||(readControl(path,"cgroup.subtree_control",enabled,sizeof(enabled))&&hasController(enabled,needed[i]))) {
+            continue;
+        }
+        char control[16];
+        snprintf(control,sizeof(control),"+%s",needed[i]);
+        if (!hasController(available,needed[i])||!writeControl(path,"cgroup.subtree_control",control)) {
+            return false;
+        }
+        if (added!=nullptr) {
+            added[i]=needed[i];
+        }
+    }
+    return true;
+}
+
+/*
+    moveShell writes the pid of the shell into the cgroup.procs of
+    the cgroup path, which moves the shell with all its threads.
+*/
+bool moveShell(const char * path) {
+    char pid[16];
+    snprintf(pid,sizeof(pid),"%d",getpid());
+    return writeControl(path,"cgroup.procs",pid);
+}
+
+/*
+    releaseParent disables the controllers of shellEnabled, first in
+    shellParent, since a controller its children use cannot be
+    disabled above it, then in shellOrigin. It moves the shell back to
+    shellOrigin and removes shellParent with its leaf. It runs at
+    exit, when the cgroups of all jobs are gone, and when the
+    controllers cannot be enabled.
+*/
+void releaseParent(void) {
+    if (shellParent[0]=='\0') {
+        return;
+    }
+    char leaf[PATH_MAX+8];
+    snprintf(leaf,sizeof(leaf),"%s/shell",shellParent);
+    for (int i=0;i!=3;++i) {
+        if (shellEnabled[i]!=nullptr) {
+            char control[16];
+            snprintf(control,sizeof(control),"-%s",shellEnabled[i]);
+            writeControl(shellParent,"cgroup.subtree_control",control);
+            writeControl(shellOrigin,"cgroup.subtree_control",control);
+            shellEnabled[i]=nullptr;
+        }
+    }
+    moveShell(shellOrigin);
+    rmdir(leaf);
+    rmdir(shellParent);
+    shellParent[0]='\0';
+}
+
+/*
+    onlyShell tells whether the shell is the only process of the
+    cgroup path, or path is the root cgroup, the one cgroup without
+    a cgroup.type, where processes and enabled controllers can be
+    together.
+*/
+bool onlyShell(const char * path) {
+    char procs[64];
+    char own[16];
+    char type[PATH_MAX+16];
+    snprintf(type,sizeof(type),"%s/cgroup.type",path);
+    if (access(type,F_OK)!=0) {
+        return true;
+    }
+    snprintf(own,sizeof(own),"%d\n",getpid());
+    return readControl(path,"cgroup.procs",procs,sizeof(procs))&&strcmp(procs,own)==0;
+}
+
+/*
+    prepareParent makes sure shellParent can hold a cgroup with the
+    controllers of needed. cgroup v2 lets only a cgroup without
+    processes of its own enable controllers for its children, which
+    the cgroup of the shell, e.g. a session scope, is not. So on the
+    first limited job, if the shell is alone in its cgroup, it creates
+    "myshell-<pid>" below it and moves itself into the leaf
+    "myshell-<pid>/shell", which leaves the cgroup it came from empty;
+    then the controllers are enabled there, if they are not yet, and
+    in "myshell-<pid>". A cgroup shared with other processes, like the
+    terminal or earlier jobs of the shell, is left alone. It returns
+    false if a step fails; the move is then undone, unless earlier
+    jobs already use "myshell-<pid>".
+*/
+bool prepareParent(const char * const * needed) {
+    static bool registered=false;
+    bool created=false;
+    if (shellParent[0]=='\0') {
+        char leaf[PATH_MAX+8];
+        if (!shellCgroup(shellOrigin,sizeof(shellOrigin))||!onlyShell(shellOrigin)||
+            snprintf(shellParent,sizeof(shellParent),"%s/myshell-%d",shellOrigin,getpid())>=(int)sizeof(shellParent)||
+            mkdir(shellParent,0755)==-1) {
+            shellParent[0]='\0';
+            return false;
+        }
+        snprintf(leaf,sizeof(leaf),"%s/shell",shellParent);
+        if (mkdir(leaf,0755)==-1||!moveShell(leaf)) {
+            releaseParent();
+            return false;
+        }
+        if (!registered) {
+            registered=true;
+            atexit(releaseParent);
+        }
+        created=true;
+    }
+    if (enableControllers(shellOrigin,needed,shellEnabled)&&enableControllers(shellParent,needed,nullptr)) {
+        return true;
+    }
+    if (created) {
+        releaseParent();
+    }
+    return false;
+}
+
+/*
+    createCgroup creates the transient cgroup "myshell-<pid>/job-<job>"
+    for a job run with limits, beside the leaf of the shell, with its
+    memory.max, cpu.max and pids.max, and opens its cgroup.procs.
+    It returns nullptr, leaving nothing behind, when the job needs no
+    cgroup or cgroup v2 is missing, read-only or lacks one of the
+    controllers, so that the job runs with its rlimits only.
+*/
+JobCgroup * createCgroup(const ResourceLimits * limits, int jobId) {
+    if (limits->memory<=0&&limits->cpu<=0&&limits->pids<=0) {
+        return nullptr;
+    }
+    const char * needed[3]={limits->memory>0?"memory":nullptr,limits->cpu>0?"cpu":nullptr,limits->pids>0?"pids":nullptr};
+    if (!prepareParent(needed)) {
+        return nullptr;
+    }
+    char buffer[256];
+    JobCgroup * cgroup=(JobCgroup*)malloc(sizeof(JobCgroup));
+    cgroup->procsFd=-1;
+    if (snprintf(cgroup->path,sizeof(cgroup->path),"%s/job-%d",shellParent,jobId)>=(int)sizeof(cgroup->path)||
+        mkdir(cgroup->path,0755)==-1) {
+        free(cgroup);
+        return nullptr;
+    }
+    bool written=true;
+    if (limits->memory>0) {
+        snprintf(buffer,sizeof(buffer),"%lld",limits->memory);
+        written=written&&writeControl(cgroup->path,"memory.max",buffer);
+    }
+    if (limits->cpu>0) {
+        snprintf(buffer,sizeof(buffer),"%lld %d",(long long)(limits->cpu*CGROUP_CPU_PERIOD),CGROUP_CPU_PERIOD);
+        written=written&&writeControl(cgroup->path,"cpu.max",buffer);
+    }
+    if (limits->pids>0) {
+        snprintf(buffer,sizeof(buffer),"%ld",limits->pids);
+        written=written&&writeControl(cgroup->path,"pids.max",buffer);
+    }
+    char procs[PATH_MAX+16];
+    snprintf(procs,sizeof(procs),"%s/cgroup.procs",cgroup->path);
+    if (written) {
+        cgroup->procsFd=moveHigh(open(procs,O_WRONLY|O_CLOEXEC));
+    }
+    if (cgroup->procsFd==-1) {
+        removeCgroup(cgroup);
+        return nullptr;
+    }
+    return cgroup;
+}
+
+/*
+    statValue returns the value of key in a "key value" stat file
+    read into stat, or -1 if it is not there.
+*/
+long long statValue(const char * stat, const char * key) {
+    size_t length=strlen(key);
+    for (const char * i=stat;i!=nullptr;) {
+        if (strncmp(i,key,length)==0&&i[length]==' ') {
+            return strtoll(i+length+1,nullptr,10);
+        }
+        i=strchr(i,'\n');
+        if (i!=nullptr) {
+            ++i;
+        }
+    }
+    return -1;
+}
+
+/*
+    reportCgroup prints on stderr what the cgroup of job jobId
+    accounted once its processes are gone: the peak of its memory
+    from memory.peak, its processes killed for memory.max, its CPU
+    time and how long and how often cpu.max throttled it.
+*/
+void reportCgroup(JobCgroup * cgroup, int jobId) {
+    char stat[1024];
+    const char * separator=" ";
+    fprintf(stderr,"myshell: [%d] limit:",jobId);
+    if (readControl(cgroup->path,"memory.peak",stat,sizeof(stat))) {
+        fprintf(stderr,"%speak memory %.1f MiB",separator,strtoll(stat,nullptr,10)/1048576.0);
+        separator=", ";
+    }
+    if (readControl(cgroup->path,"memory.events",stat,sizeof(stat))&&statValue(stat,"oom_kill")>0) {
+        fprintf(stderr,"%s%lld killed out of memory",separator,statValue(stat,"oom_kill"));
+        separator=", ";
+    }
+    if (readControl(cgroup->path,"cpu.stat",stat,sizeof(stat))) {
+        fprintf(stderr,"%scpu %.3f s",separator,statValue(stat,"usage_usec")/1e6);
+        if (statValue(stat,"throttled_usec")>=0) {
+            fprintf(stderr,", throttled %.3f s in %lld periods",statValue(stat,"throttled_usec")/1e6,statValue(stat,"nr_throttled"));
+        }
+    }
+    fprintf(stderr,"\n");
+}
+
+/*
+    removeCgroup closes the cgroup.procs of cgroup and removes its
+    directory, which only succeeds once its processes are gone.
+*/
+void removeCgroup(JobCgroup * cgroup) {
+    if (cgroup->procsFd!=-1) {
+        close(cgroup->procsFd);
+    }
+    rmdir(cgroup->path);
+    free(cgroup);
+}
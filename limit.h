@@ -0,0 +1,25 @@
+#ifndef LIMIT_H
+#define LIMIT_H
+#include "util.h"
+#include "spawn.h"
+#include <limits.h>
+
+#define LIMIT_RESOURCES 3
+#define CGROUP_CPU_PERIOD 100000
+
+/*
+    JobCgroup is the transient cgroup v2 of a limited job: path is its
+    directory and procsFd its cgroup.procs, into which every process
+    of the job writes itself before it execs.
+*/
+typedef struct JobCgroup {
+    char path[PATH_MAX];
+    int procsFd;
+} JobCgroup;
+
+bool parseLimits(int * argc, char *** argv, ResourceLimits * limits);
+int spawnLimits(const ResourceLimits * limits, bool cgroup, SpawnLimit * result);
+JobCgroup * createCgroup(const ResourceLimits * limits, int jobId);
+void reportCgroup(JobCgroup * cgroup, int jobId);
+void removeCgroup(JobCgroup * cgroup);
+#endif //LIMIT_H
@@ -0,0 +1,277 @@
+#include "lineedit.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+void initEditor(LineEditor * editor, History * history, const char * prompt) {
+    editor->history=history;
+    editor->prompt=prompt;
+    initText(&editor->line);
+    initText(&editor->query);
+    initText(&editor->accepted);
+    editor->terminal=tcgetattr(STDIN_FILENO,&editor->cooked)==0;
+    editor->raw=false;
+    resetEditor(editor);
+}
+
+void freeEditor(LineEditor * editor) {
+    leaveRaw(editor);
+    freeText(&editor->line);
+    freeText(&editor->query);
+    freeText(&editor->accepted);
+}
+
+/*
+    enterRaw turns off canonical mode and echo, starting from the
+    modes saved at startup so that a job which left the terminal in
+    another mode does not affect the prompt.
+*/
+void enterRaw(LineEditor * editor) {
+    if (!editor->terminal||editor->raw) {
+        return;
+    }
+    struct termios raw=editor->cooked;
+    raw.c_lflag&=~(ICANON|ECHO|IEXTEN);
+    raw.c_cc[VMIN]=1;
+    raw.c_cc[VTIME]=0;
+    editor->raw=tcsetattr(STDIN_FILENO,TCSANOW,&raw)==0;
+}
+
+/*
+    leaveRaw restores the saved modes before a command runs.
+*/
+void leaveRaw(LineEditor * editor) {
+    if (editor->raw) {
+        tcsetattr(STDIN_FILENO,TCSANOW,&editor->cooked);
+        editor->raw=false;
+    }
+}
+
+void resetEditor(LineEditor * editor) {
+    editor->line.size=0;
+    editor->line.data[0]='\0';
+    editor->query.size=0;
+    editor->query.data[0]='\0';
+    editor->searching=false;
+    editor->failed=false;
+    editor->match=-1;
+    editor->matchLength=0;
+    editor->browse=SIZE_MAX;
+    editor->browseLength=0;
+    editor->escapeLength=0;
+}
+
+/*
+    redraw rewrites the current terminal line: the prompt and the
+    line, or the search prompt and the current match.
+*/
+void redraw(LineEditor * editor) {
+    TextBuffer screen;
+    initText(&screen);
+    appendText(&screen,"\r",1);
+    if (editor->searching) {
+        appendFormat(&screen,"(%sreverse-i-search)`%s': ",editor->failed?"failed ":"",editor->query.data);
+        if (editor->match!=-1) {
+            appendText(&screen,editor->history->map+editor->match,editor->matchLength);
+        }
+    } else {
+        appendText(&screen,editor->prompt,strlen(editor->prompt));
+        appendText(&screen,editor->line.data,editor->line.size);
+    }
+    appendText(&screen,"\033[K",3);
+    writeText(STDOUT_FILENO,&screen);
+    freeText(&screen);
+}
+
+/*
+    startLine prints the prompt and whatever was typed so far.
+*/
+void startLine(LineEditor * editor) {
+    enterRaw(editor);
+    redraw(editor);
+}
+
+void setLine(LineEditor * editor, const char * data, size_t size) {
+    editor->line.size=0;
+    appendText(&editor->line,data,size);
+}
+
+/*
+    searchFrom looks for the query in the entries before the offset
+    before. A failed search keeps the previous match on the screen.
+*/
+void searchFrom(LineEditor * editor, size_t before) {
+    size_t length=0;
+    ssize_t match=searchHistory(editor->history,editor->query.data,before,&length);
+    editor->failed=match==-1;
+    if (match!=-1) {
+        editor->match=match;
+        editor->matchLength=length;
+    }
+}
+
+/*
+    stopSearch leaves the search with the match as the line.
+*/
+void stopSearch(LineEditor * editor) {
+    if (editor->match!=-1) {
+        setLine(editor,editor->history->map+editor->match,editor->matchLength);
+    }
+    editor->searching=false;
+}
+
+/*
+    browseHistory shows the entry before (up) or after the one shown.
+    Stepping down past the newest entry gives an empty line again.
+*/
+void browseHistory(LineEditor * editor, bool up) {
+    size_t length=0;
+    ssize_t entry=-1;
+    if (up) {
+        entry=searchHistory(editor->history,"",editor->browse,&length);
+    } else if (editor->browse!=SIZE_MAX) {
+        entry=nextHistory(editor->history,editor->browse+editor->browseLength+1,&length);
+        if (entry==-1) {
+            editor->browse=SIZE_MAX;
+            setLine(editor,"",0);
+        }
+    }
+    if (entry!=-1) {
+        editor->browse=entry;
+        editor->browseLength=length;
+        setLine(editor,editor->history->map+entry,length);
+    }
+}
+
+/*
+    escapeSequence handles a complete escape sequence: only the
+    arrow keys Up and Down mean something, the others are dropped.
+*/
+void escapeSequence(LineEditor * editor) {
+    char key=editor->escape[editor->escapeLength-1];
+    if ((editor->escape[1]=='['||editor->escape[1]=='O')&&(key=='A'||key=='B')) {
+        browseHistory(editor,key=='A');
+    }
+    editor->escapeLength=0;
+}
+
+/*
+    removeLast deletes the last character of text, all bytes of it
+    if it is UTF-8.
+*/
+void removeLast(TextBuffer * text) {
+    while (text->size!=0&&((unsigned char)text->data[text->size-1]&0xc0)==0x80) {
+        --text->size;
+    }
+    if (text->size!=0) {
+        --text->size;
+    }
+    text->data[text->size]='\0';
+}
+
+/*
+    editKey handles one byte typed outside of the search. It returns
+    true if the byte ends the line.
+*/
+bool editKey(LineEditor * editor, unsigned char c) {
+    if (c=='\n'||c=='\r') {
+        return true;
+    } else if (c==CTRL('R')) {
+        editor->searching=true;
+        editor->failed=false;
+        editor->match=-1;
+        editor->query.size=0;
+        editor->query.data[0]='\0';
+    } else if (c==0x7f||c==CTRL('H')) {
+        removeLast(&editor->line);
+    } else if (c==CTRL('U')) {
+        setLine(editor,"",0);
+    } else if (c==CTRL('L')) {
+        write(STDOUT_FILENO,"\033[H\033[2J",7);
+    } else if (c==0x1b) {
+        editor->escape[0]=c;
+        editor->escapeLength=1;
+    } else if (c>=0x20||c=='\t') {
+        appendText(&editor->line,(char*)&c,1);
+    }
+    return false;
+}
+
+/*
+    searchKey handles one byte typed during a Ctrl-R search: another
+    Ctrl-R looks further back, a character or a backspace changes the
+    query and searches again from the newest entry that can still
+    match, Ctrl-G gives up and any other key ends the search with the
+    match as the line before it is handled. It returns true if the
+    byte ends the line.
+*/
+bool searchKey(LineEditor * editor, unsigned char c) {
+    if (c==CTRL('R')) {
+        if (editor->query.size!=0) {
+            searchFrom(editor,editor->match==-1?SIZE_MAX:(size_t)editor->match);
+        }
+    } else if (c==0x7f||c==CTRL('H')) {
+        removeLast(&editor->query);
+        editor->match=-1;
+        editor->failed=false;
+        if (editor->query.size!=0) {
+            searchFrom(editor,SIZE_MAX);
+        }
+    } else if (c==CTRL('G')) {
+        editor->searching=false;
+    } else if ((c>=0x20&&c!=0x7f)||c=='\t') {
+        appendText(&editor->query,(char*)&c,1);
+        searchFrom(editor,editor->match==-1?SIZE_MAX:editor->match+editor->matchLength+1);
+    } else {
+        stopSearch(editor);
+        return editKey(editor,c);
+    }
+    return false;
+}
+
+/*
+    editLine handles the bytes the reader holds. When a line ends it
+    restores the terminal and returns the line, valid until the next
+    call; the bytes after it stay in the reader for the next line.
+    Otherwise it redraws and returns nullptr.
+    Ctrl-D on an empty line ends the input like end of file.
+*/
+char * editLine(LineEditor * editor, LineReader * reader) {
+    bool changed=false;
+    while (reader->position<reader->size) {
+        unsigned char c=(unsigned char)reader->buffer[reader->position++];
+        changed=true;
+        if (editor->escapeLength!=0) {
+            editor->escape[editor->escapeLength++]=c;
+            bool bracket=editor->escape[1]=='['||editor->escape[1]=='O';
+            if (!bracket||(editor->escapeLength>2&&c>=0x40&&c<=0x7e)) {
+                escapeSequence(editor);
+            } else if (editor->escapeLength==EDITOR_ESCAPE_SIZE) {
+                editor->escapeLength=0;
+            }
+            continue;
+        }
+        if (c==CTRL('D')&&!editor->searching&&editor->line.size==0) {
+            leaveRaw(editor);
+            reader->eof=true;
+            return nullptr;
+        }
+        bool done=editor->searching?searchKey(editor,c):editKey(editor,c);
+        if (done) {
+            if (editor->searching) {
+                stopSearch(editor);
+            }
+            redraw(editor);
+            write(STDOUT_FILENO,"\n",1);
+            leaveRaw(editor);
+            editor->accepted.size=0;
+            appendText(&editor->accepted,editor->line.data,editor->line.size);
+            resetEditor(editor);
+            return editor->accepted.data;
+        }
+    }
+    if (changed) {
+        redraw(editor);
+    }
+    return nullptr;
+}
@@ -0,0 +1,44 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+#include "util.h"
+#include "input.h"
+#include "history.h"
+#include <termios.h>
+
+#define EDITOR_ESCAPE_SIZE 8
+
+/*
+    LineEditor reads the lines of an interactive shell from the bytes
+    of a LineReader with the terminal in non-canonical mode, so that
+    it can offer the history: Up and Down step through the entries
+    and Ctrl-R starts an incremental reverse search for query, whose
+    current result is the entry at match. browse is the entry shown
+    by Up and Down, SIZE_MAX while the line is a new one. ISIG stays
+    on, so Ctrl-C and Ctrl-Z still raise signals.
+*/
+typedef struct LineEditor {
+    History * history;
+    const char * prompt;
+    TextBuffer line;
+    TextBuffer query;
+    TextBuffer accepted;
+    bool searching;
+    bool failed;
+    ssize_t match;
+    size_t matchLength;
+    size_t browse;
+    size_t browseLength;
+    char escape[EDITOR_ESCAPE_SIZE];
+    int escapeLength;
+    struct termios cooked;
+    bool terminal;
+    bool raw;
+} LineEditor;
+
+void initEditor(LineEditor * editor, History * history, const char * prompt);
+void startLine(LineEditor * editor);
+void resetEditor(LineEditor * editor);
+char * editLine(LineEditor * editor, LineReader * reader);
+void leaveRaw(LineEditor * editor);
+void freeEditor(LineEditor * editor);
+#endif //LINEEDIT_H
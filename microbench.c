@@ -0,0 +1,725 @@
+/*
+    microbench measures the shell's own hot paths: parsing, spawning,
+    pipeline setup, redirections, command substitution, globbing, the
+    process tree, reaping and the history. Every case is run
+    MICROBENCH_SAMPLES times and the median is reported in ns/op and
+    ops/s, with the mean number of malloc, calloc and realloc calls
+    per op. With --baseline file it exits with status 1 when a case
+    is slower than its baseline by more than the tolerance (in
+    percent); --save file writes the results as a new baseline. Some
+    cases also check what they ran; a failed check is reported and
+    makes the exit status 1 as well.
+
+    Compilation: make microbench
+    Usage: ./microbench [--baseline file] [--tolerance pct] [--save file]
+*/
+#include "parser.h"
+#include "execute.h"
+#include "jobs.h"
+#include "sig.h"
+#include "spawn.h"
+#include "viewtree.h"
+#include "procstat.h"
+#include "history.h"
+#include "capture.h"
+#include "wildcard.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <wait.h>
+#include <glob.h>
+#include <dirent.h>
+
+#define MICROBENCH_SAMPLES 5
+#define MICROBENCH_TREE_SIZE 256
+#define MICROBENCH_TOLERANCE 50.0
+#define MICROBENCH_HISTORY_SIZE 1000000
+#define MICROBENCH_INPUT_SIZE (64 << 20)
+#define MICROBENCH_DIRECTORY_SIZE 200000
+#define MICROBENCH_PIPELINE_STAGES 1000
+#define MICROBENCH_PIPELINE_LINES 100000
+#define MICROBENCH_REAP_JOBS 10000
+
+/*
+    A case runs iterations operations per sample and returns the time
+    they took in seconds, leaving out its own setup.
+*/
+typedef struct BenchCase {
+    const char *name;
+    long iterations;
+    double (*run)(long iterations);
+} BenchCase;
+
+/*
+    microbench is linked with --wrap=malloc, --wrap=calloc and
+    --wrap=realloc, so every such call of the shell's own objects
+    lands here and is counted in allocations.
+*/
+static long allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t number, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    ++allocations;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t number, size_t size) {
+    ++allocations;
+    return __real_calloc(number, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    ++allocations;
+    return __real_realloc(pointer, size);
+}
+
+static char *parse_lines[] = {
+    "ls -l /tmp",
+    "cat access.log | grep GET | cut -d ' ' -f 7 | sort | uniq -c | sort -rn | head -20",
+    "sleep 10 &",
+    "tar cf - src |{ gzip -1 , sha256sum , wc -c }",
+};
+
+static int failed_checks = 0;
+
+/*
+    check reports on stderr that a case did not do what it should;
+    microbench then exits with status 1, as for a regression.
+*/
+void check(bool passed, const char *name, const char *what) {
+    if (!passed) {
+        fprintf(stderr, "microbench: %s: %s\n", name, what);
+        ++failed_checks;
+    }
+}
+
+/*
+    returns the number of fds the shell holds open.
+*/
+int count_fds() {
+    DIR *directory = opendir("/proc/self/fd");
+    int number = 0;
+    if (directory == NULL) {
+        return -1;
+    }
+    while (readdir(directory) != NULL) {
+        ++number;
+    }
+    closedir(directory);
+    return number;
+}
+
+/*
+    "true" is a built-in now; the spawn cases exec /bin/true so that
+    they keep measuring a fork and exec.
+*/
+static char *true_argv[] = {"/bin/true", NULL};
+
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/*
+    check_expansion checks that the substitutions of a line are
+    expanded before "limit" and the "@" modifiers read their values,
+    and that those of a bench line are left for bench to expand.
+*/
+void check_expansion() {
+    Line *line = parse("limit --pids $(echo 50) /bin/true");
+    check(line != NULL && line->limits->pids == 50, "parse", "limit did not get its expanded value");
+    if (line != NULL) {
+        freeLine(line);
+    }
+    line = parse("@nice=$(echo 5) /bin/true");
+    check(line != NULL && line->head->placement != NULL && line->head->placement->nice == 5, "parse", "@nice did not get its expanded value");
+    if (line != NULL) {
+        freeLine(line);
+    }
+    line = parse("bench -n 1 echo $(echo x)");
+    check(line != NULL && line->type == BENCH_TYPE && strcmp(line->head->argv[line->head->argc - 1], "$(echo x)") == 0, "parse", "a bench line was expanded");
+    if (line != NULL) {
+        freeLine(line);
+    }
+}
+
+/*
+    parse() and freeLine() on a mix of simple, piped, background and
+    fan-out lines; its allocs/op is the number of allocations per line.
+    The expansion checks run first, outside the timing.
+*/
+double bench_parse(long iterations) {
+    int line_number = sizeof(parse_lines) / sizeof(parse_lines[0]);
+    check_expansion();
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        Line *line = parse(parse_lines[i % line_number]);
+        if (line != NULL) {
+            freeLine(line);
+        }
+    }
+    return now() - begin;
+}
+
+/*
+    spawn and wait for /bin/true through run_command() and the job table,
+    i.e. the latency of a foreground command without the parser.
+*/
+double bench_spawn_wait(long iterations) {
+    Command command = {.argc = 1, .argv = true_argv, .next = NULL, .redirects = NULL, .placement = NULL};
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        Job *job = create_job("true", 0, 0);
+        run_command(&command, -1, -1, job);
+        start_job(job);
+    }
+    return now() - begin;
+}
+
+/*
+    execute() of an 8-stage pipeline of /bin/true, i.e. pipe creation,
+    8 spawns and the wait for all of them.
+*/
+double bench_pipeline(long iterations) {
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        Line *line = parse("/bin/true | /bin/true | /bin/true | /bin/true | /bin/true | /bin/true | /bin/true | /bin/true");
+        execute(line);
+    }
+    return now() - begin;
+}
+
+/*
+    execute() of "seq 1 100000 | cat | ... | wc -l > file" with
+    MICROBENCH_PIPELINE_STAGES stages. It checks that all the lines
+    got through and that the shell holds as many fds afterwards as
+    before, since every pipe end is closed once its stage is spawned.
+*/
+double bench_pipeline_1000(long iterations) {
+    char output_path[] = "/tmp/microbench_pipelineXXXXXX";
+    close(mkstemp(output_path));
+    TextBuffer text;
+    initText(&text);
+    appendFormat(&text, "seq 1 %d", MICROBENCH_PIPELINE_LINES);
+    for (int i = 2; i < MICROBENCH_PIPELINE_STAGES; i++) {
+        appendText(&text, " | cat", 6);
+    }
+    appendFormat(&text, " | wc -l > %s", output_path);
+    int fds = count_fds();
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        execute(parse(text.data));
+    }
+    double elapsed = now() - begin;
+    check(count_fds() == fds, "pipeline_1000", "the shell holds more fds than before the pipeline");
+    FILE *output = fopen(output_path, "r");
+    long lines = -1;
+    if (output != NULL) {
+        fscanf(output, "%ld", &lines);
+        fclose(output);
+    }
+    check(lines == MICROBENCH_PIPELINE_LINES, "pipeline_1000", "wc -l did not count every line");
+    unlink(output_path);
+    freeText(&text);
+    return elapsed;
+}
+
+/*
+    the 8-stage pipeline with @spread and a nice value, i.e. what the
+    sched_setaffinity and setpriority calls of every child add.
+*/
+double bench_pipeline_spread(long iterations) {
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        Line *line = parse("@spread @nice=1 /bin/true | /bin/true | /bin/true | /bin/true | /bin/true | /bin/true | /bin/true | /bin/true");
+        execute(line);
+    }
+    return now() - begin;
+}
+
+/*
+    execute() of the built-in "true", i.e. what a standalone built-in
+    costs without a fork.
+*/
+double bench_builtin_true(long iterations) {
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        execute(parse("true"));
+    }
+    return now() - begin;
+}
+
+double bench_pid_node(long iterations) {
+    pid_t pid = getpid();
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        PIDNode *node = buildPIDNode(pid);
+        free(node->name);
+        free(node);
+    }
+    return now() - begin;
+}
+
+/*
+    parseProcStat() of a stat line read once before timing, i.e. the
+    parse cost per process without the system calls.
+*/
+double bench_proc_stat_parse(long iterations) {
+    char buffer[PROC_STAT_BUFFER];
+    ProcStat stat;
+    int fd = open("/proc/self/stat", O_RDONLY);
+    ssize_t length = read(fd, buffer, sizeof(buffer));
+    close(fd);
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        parseProcStat(buffer, length, &stat);
+    }
+    return now() - begin;
+}
+
+/*
+    readProcStat() of our own pid: open, pread, close and parse.
+*/
+double bench_proc_stat_read(long iterations) {
+    pid_t pid = getpid();
+    ProcStat stat;
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        readProcStat(pid, &stat);
+    }
+    return now() - begin;
+}
+
+/*
+    buildTree() of our own subtree while MICROBENCH_TREE_SIZE sleeping
+    children exist, as viewtree would see it.
+*/
+double bench_tree(long iterations) {
+    static char *sleep_argv[] = {"sleep", "1000", NULL};
+    pid_t children[MICROBENCH_TREE_SIZE];
+    for (int i = 0; i < MICROBENCH_TREE_SIZE; i++) {
+        SpawnAttr attr;
+        initSpawnAttr(&attr);
+        children[i] = spawnCommand(sleep_argv, &attr);
+    }
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        freeTree(buildTree(getpid()));
+    }
+    double elapsed = now() - begin;
+    for (int i = 0; i < MICROBENCH_TREE_SIZE; i++) {
+        if (children[i] > 0) {
+            kill(children[i], SIGKILL);
+            waitpid(children[i], NULL, 0);
+        }
+    }
+    return elapsed;
+}
+
+/*
+    check_reap starts MICROBENCH_REAP_JOBS background jobs of
+    /bin/true and drains them with reap_children() as the main loop
+    would. It checks that no child is left as a zombie and that the
+    job table is empty afterwards.
+*/
+void check_reap() {
+    Command command = {.argc = 1, .argv = true_argv, .next = NULL, .redirects = NULL, .placement = NULL};
+    for (int i = 0; i < MICROBENCH_REAP_JOBS; i++) {
+        Job *job = create_job("true", 1, 0);
+        run_command(&command, -1, -1, job);
+        start_job(job);
+    }
+    struct pollfd event = {SIGCHLD_fd(), POLLIN, 0};
+    double deadline = now() + 60;
+    while (!jobs_empty() && now() < deadline) {
+        if (reap_children() == 0) {
+            poll(&event, 1, 100);
+        }
+    }
+    siginfo_t info = {0};
+    bool zombie = waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid != 0;
+    check(!zombie, "reap", "a background job was left as a zombie");
+    check(jobs_empty(), "reap", "the job table is not empty after every job was reaped");
+}
+
+/*
+    reap_children() of iterations exited background jobs: the jobs
+    are started and given time to exit first, so only the signalfd
+    drain and the wait4() calls are timed. The first sample runs
+    check_reap() before, outside the timing and the allocation count.
+*/
+double bench_reap(long iterations) {
+    static bool checked = false;
+    if (!checked) {
+        long allocated = allocations;
+        checked = true;
+        check_reap();
+        allocations = allocated;
+    }
+    Command command = {.argc = 1, .argv = true_argv, .next = NULL, .redirects = NULL, .placement = NULL};
+    for (long i = 0; i < iterations; i++) {
+        Job *job = create_job("true", 1, 0);
+        run_command(&command, -1, -1, job);
+        start_job(job);
+    }
+    usleep(100000 + iterations * 50);
+    long reaped = 0;
+    double elapsed = 0;
+    struct pollfd event = {SIGCHLD_fd(), POLLIN, 0};
+    while (reaped < iterations) {
+        double begin = now();
+        reaped += reap_children();
+        elapsed += now() - begin;
+        if (reaped < iterations) {
+            poll(&event, 1, 100);
+        }
+    }
+    return elapsed;
+}
+
+static char history_path[] = "/tmp/microbench_historyXXXXXX";
+
+void remove_history_file() {
+    unlink(history_path);
+}
+
+/*
+    returns a history file of MICROBENCH_HISTORY_SIZE varied entries,
+    written on first use. Only its oldest entry contains "needle".
+*/
+const char *history_file() {
+    static int fd = -1;
+    if (fd != -1) {
+        return history_path;
+    }
+    static const char *formats[] = {
+        "git commit -m 'fix issue %d'",
+        "make -j%d all",
+        "grep -rn pattern%d src/",
+        "cd /srv/app%d/releases",
+        "ssh build%d.example.com uptime",
+        "cat /var/log/app%d.log | grep ERROR | tail -50",
+    };
+    fd = mkstemp(history_path);
+    atexit(remove_history_file);
+    TextBuffer text;
+    initText(&text);
+    appendText(&text, "echo needle\n", 12);
+    for (int i = 1; i < MICROBENCH_HISTORY_SIZE; i++) {
+        appendFormat(&text, formats[i % 6], i);
+        appendText(&text, "\n", 1);
+    }
+    writeText(fd, &text);
+    freeText(&text);
+    return history_path;
+}
+
+/*
+    openHistory() and closeHistory() of the 1M-entry file, i.e. what
+    the history costs at startup.
+*/
+double bench_history_open(long iterations) {
+    const char *path = history_file();
+    History history;
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        openHistory(&history, path);
+        closeHistory(&history);
+    }
+    return now() - begin;
+}
+
+/*
+    indexHistory() of the 1M-entry file, done once by the first search.
+*/
+double bench_history_index(long iterations) {
+    const char *path = history_file();
+    History history;
+    double elapsed = 0;
+    for (long i = 0; i < iterations; i++) {
+        openHistory(&history, path);
+        double begin = now();
+        indexHistory(&history);
+        elapsed += now() - begin;
+        closeHistory(&history);
+    }
+    return elapsed;
+}
+
+/*
+    one Ctrl-R step on the indexed 1M-entry file for a query whose
+    only match is the oldest entry, so that every block is checked.
+*/
+double bench_history_search(long iterations) {
+    History history;
+    size_t length;
+    openHistory(&history, history_file());
+    indexHistory(&history);
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        searchHistory(&history, "needle", SIZE_MAX, &length);
+    }
+    double elapsed = now() - begin;
+    closeHistory(&history);
+    return elapsed;
+}
+
+static char input_path[] = "/tmp/microbench_inputXXXXXX";
+
+void remove_input_file() {
+    unlink(input_path);
+}
+
+/*
+    returns a text file of MICROBENCH_INPUT_SIZE bytes in lines of 64,
+    written on first use.
+*/
+const char *input_file() {
+    static int fd = -1;
+    if (fd != -1) {
+        return input_path;
+    }
+    fd = mkstemp(input_path);
+    atexit(remove_input_file);
+    TextBuffer text;
+    initText(&text);
+    appendChars(&text, 'x', 63);
+    appendText(&text, "\n", 1);
+    for (size_t written = 0; written < MICROBENCH_INPUT_SIZE; written += text.size) {
+        write(fd, text.data, text.size);
+    }
+    freeText(&text);
+    return input_path;
+}
+
+/*
+    execute() of line with %s replaced by the input file, i.e. the
+    whole run of a command reading MICROBENCH_INPUT_SIZE bytes.
+*/
+double run_input_line(const char *format, long iterations) {
+    char text[256];
+    snprintf(text, sizeof(text), format, input_file());
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        execute(parse(text));
+    }
+    return now() - begin;
+}
+
+/*
+    "cat f | wc -l" against "wc -l < f" on the same input: the pipe
+    costs a second process and a copy of every byte through it.
+*/
+double bench_cat_pipe(long iterations) {
+    return run_input_line("cat %s | wc -l > /dev/null", iterations);
+}
+
+double bench_redirect_input(long iterations) {
+    return run_input_line("wc -l < %s > /dev/null", iterations);
+}
+
+/*
+    captureOutput() of "cat f" for the 64 MiB input file, i.e. a
+    command substitution of multi-megabyte output.
+*/
+double bench_capture(long iterations) {
+    char command[256];
+    snprintf(command, sizeof(command), "cat %s", input_file());
+    Capture capture;
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        captureOutput(command, &capture);
+        freeText(&capture.output);
+    }
+    return now() - begin;
+}
+
+static char directory_path[] = "/tmp/microbench_globXXXXXX";
+
+void remove_directory() {
+    char path[64];
+    for (int i = 0; i < MICROBENCH_DIRECTORY_SIZE; i++) {
+        snprintf(path, sizeof(path), "%s/entry%06d.%s", directory_path, i, i % 4 == 0 ? "txt" : "log");
+        unlink(path);
+    }
+    rmdir(directory_path);
+}
+
+/*
+    returns a directory of MICROBENCH_DIRECTORY_SIZE empty files,
+    three quarters of them *.log, created on first use.
+*/
+const char *glob_directory() {
+    static bool created = false;
+    if (created) {
+        return directory_path;
+    }
+    created = true;
+    mkdtemp(directory_path);
+    atexit(remove_directory);
+    char path[64];
+    for (int i = 0; i < MICROBENCH_DIRECTORY_SIZE; i++) {
+        snprintf(path, sizeof(path), "%s/entry%06d.%s", directory_path, i, i % 4 == 0 ? "txt" : "log");
+        close(open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+    }
+    return directory_path;
+}
+
+/*
+    expandWildcard() of the "*.log" pattern in the 200k-entry directory,
+    against glob(3) of the same pattern. Both return sorted paths.
+*/
+double bench_wildcard(long iterations) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "%s/*.log", glob_directory());
+    WildcardMatches matches;
+    initMatches(&matches);
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        matches.number = 0;
+        matches.names.size = 0;
+        expandWildcard(pattern, &matches);
+    }
+    double elapsed = now() - begin;
+    freeMatches(&matches);
+    return elapsed;
+}
+
+double bench_glob3(long iterations) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "%s/*.log", glob_directory());
+    double begin = now();
+    for (long i = 0; i < iterations; i++) {
+        glob_t result;
+        glob(pattern, 0, NULL, &result);
+        globfree(&result);
+    }
+    return now() - begin;
+}
+
+static BenchCase cases[] = {
+    {"parse", 200000, bench_parse},
+    {"spawn_wait", 500, bench_spawn_wait},
+    {"pipeline_8", 100, bench_pipeline},
+    {"pipeline_1000", 1, bench_pipeline_1000},
+    {"builtin_true", 100000, bench_builtin_true},
+    {"build_pid_node", 20000, bench_pid_node},
+    {"proc_stat_parse", 1000000, bench_proc_stat_parse},
+    {"proc_stat_read", 20000, bench_proc_stat_read},
+    {"build_tree_256", 200, bench_tree},
+    {"reap", 2000, bench_reap},
+    {"history_open_1m", 10000, bench_history_open},
+    {"history_index_1m", 1, bench_history_index},
+    {"history_search_1m", 100, bench_history_search},
+    {"cat_pipe_64m", 5, bench_cat_pipe},
+    {"redirect_input_64m", 5, bench_redirect_input},
+    {"capture_64m", 5, bench_capture},
+    {"wildcard_200k", 5, bench_wildcard},
+    {"glob3_200k", 5, bench_glob3},
+    {"pipeline_8_spread", 100, bench_pipeline_spread},
+};
+
+int compare_samples(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+    returns the ns/op of name in the baseline file, or -1.
+*/
+double baseline_of(const char *path, const char *name) {
+    FILE *file = path != NULL ? fopen(path, "r") : NULL;
+    if (file == NULL) {
+        return -1;
+    }
+    char key[64];
+    double value;
+    double result = -1;
+    while (fscanf(file, "%63s %lf", key, &value) == 2) {
+        if (strcmp(key, name) == 0) {
+            result = value;
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+int main(int argc, char const *argv[]) {
+    const char *baseline = NULL;
+    const char *save = NULL;
+    double tolerance = MICROBENCH_TOLERANCE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--baseline file] [--tolerance pct] [--save file]\n", argv[0]);
+            return 2;
+        }
+    }
+    SIGCHLD_handler_wrapper();
+    init_job_control(false);
+    FILE *saved = NULL;
+    if (save != NULL && (saved = fopen(save, "w")) == NULL) {
+        perror(save);
+        return 2;
+    }
+
+    // the commands and the Done messages of background jobs go to /dev/null.
+    fflush(stdout);
+    int out = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    FILE *report = fdopen(out, "w");
+    fprintf(report, "%-18s%14s%14s%12s%14s%10s\n", "case", "ns/op", "ops/s", "allocs/op", "baseline", "change");
+    fflush(report);
+    int regressed = 0;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        double samples[MICROBENCH_SAMPLES];
+        dup2(null, STDOUT_FILENO);
+        long allocated = allocations;
+        for (int s = 0; s < MICROBENCH_SAMPLES; s++) {
+            samples[s] = cases[c].run(cases[c].iterations) * 1e9 / cases[c].iterations;
+        }
+        fflush(stdout);
+        qsort(samples, MICROBENCH_SAMPLES, sizeof(double), compare_samples);
+        double median = samples[MICROBENCH_SAMPLES / 2];
+        double expected = baseline_of(baseline, cases[c].name);
+        double allocs = (double)(allocations - allocated) / (cases[c].iterations * MICROBENCH_SAMPLES);
+        fprintf(report, "%-18s%14.1lf%14.0lf%12.1lf", cases[c].name, median, 1e9 / median, allocs);
+        if (expected > 0) {
+            double change = (median - expected) * 100 / expected;
+            bool slower = change > tolerance;
+            regressed += slower;
+            fprintf(report, "%14.1lf%+9.1lf%%%s\n", expected, change, slower ? "  REGRESSED" : "");
+        } else {
+            fprintf(report, "%14s%10s\n", "-", "-");
+        }
+        fflush(report);
+        if (saved != NULL) {
+            fprintf(saved, "%s %.1lf\n", cases[c].name, median);
+        }
+    }
+    if (saved != NULL) {
+        fclose(saved);
+    }
+    if (regressed > 0) {
+        fprintf(report, "%d case(s) regressed by more than %.0lf%%\n", regressed, tolerance);
+    }
+    if (failed_checks > 0) {
+        fprintf(report, "%d check(s) failed\n", failed_checks);
+    }
+    fclose(report);
+    return regressed > 0 || failed_checks > 0 ? 1 : 0;
+}
@@ -10,56 +10,202 @@ Compilation: make myshell
 #include "parser.h"
 #include "execute.h"
 #include "sig.h"
+#include "jobs.h"
+#include "input.h"
+#include "history.h"
+#include "lineedit.h"
+#include "redirect.h"
 #include <sys/wait.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
-extern sig_atomic_t timeX_flag;
+extern volatile sig_atomic_t sigint_flag;
+
+#define REAP_BATCH 64
+#define PROMPT "## myshell $ "
+#define CONTINUE_PROMPT "> "
 
 
 
 /*
-    get_command reads contents from stdin and stores it to buffer.
-    If there's no input or the number of arguments is greater than
-    the maximum arguments number, it returns false.
+    open_input sets up reader according to the arguments:
+    "myshell -c commands" runs the given commands, "myshell script"
+    runs the script and plain "myshell" reads stdin. It returns
+    true if the shell is interactive, i.e. reads from a terminal.
 */
-bool get_command(char * buffer) {
-    memset(buffer, 0,BUFFER_SIZE * sizeof(char));
-    char * input = fgets(buffer,BUFFER_SIZE,stdin);
-    if (input == nullptr) {
+bool open_input(LineReader * reader, int argc, char const *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fprintf(stderr, "myshell: -c: option requires an argument\n");
+            exit(EXIT_FAILURE);
+        }
+        initStringReader(reader, argv[2]);
         return false;
     }
-    if (split_input(input,nullptr," ",false)>MAX_ARGS_NUMBER) {
-        fprintf(stderr,"myshell: Too many arguments\n");
+    if (argc >= 2) {
+        int fd = moveHigh(open(argv[1], O_RDONLY | O_CLOEXEC));
+        if (fd == -1) {
+            fprintf(stderr, "myshell: %s: %s\n", argv[1], strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        initReader(reader, fd);
         return false;
     }
+    initReader(reader, STDIN_FILENO);
+    return isatty(STDIN_FILENO);
+}
+
+/*
+    open_history maps the history file named by $HISTFILE, or
+    ~/.myshell_history. Nothing in it is read until it is searched.
+*/
+void open_history(History * history) {
+    const char * path = getenv("HISTFILE");
+    TextBuffer home;
+    initText(&home);
+    if (path == NULL && getenv("HOME") != NULL) {
+        appendFormat(&home, "%s/%s", getenv("HOME"), HISTORY_FILE);
+        path = home.data;
+    }
+    if (path != NULL) {
+        openHistory(history, path);
+    }
+    freeText(&home);
+}
+
+/*
+    wait_for_input blocks in epoll_wait until stdin is readable or
+    a child has exited, reaps exited children and reads what is
+    available. An input that epoll cannot watch, e.g. a regular
+    file, never blocks and is read directly. reaped is set if any
+    child was reaped. It returns false if the wait was interrupted
+    by SIGINT.
+*/
+bool wait_for_input(int epfd, LineReader * reader, bool * reaped) {
+    if (epfd == -1) {
+        reap_children();
+        return fillReader(reader);
+    }
+    struct epoll_event events[2];
+    int ready = epoll_wait(epfd, events, 2, -1);
+    if (ready == -1) {
+        return errno != EINTR;
+    }
+    for (int i = 0; i < ready; i++) {
+        if (events[i].data.fd == SIGCHLD_fd()) {
+            *reaped = reap_children() > 0;
+        } else if (!fillReader(reader)) {
+            return false;
+        }
+    }
     return true;
 }
 
 /*
     the entry point of myshell.
-    It initializes signal handlers and then enters the while loop 
-    reading from buffer, parse the input and if the input is valid,
-    execute the line.
+    It initializes signal handlers and then runs one event loop:
+    epoll waits on both stdin and the SIGCHLD signalfd, so input and
+    exiting children are handled in one place. Every complete line is
+    parsed and, if valid, executed. An interactive shell prints a
+    prompt; a script is read in large chunks without prompts and
+    exited children are reaped at least every REAP_BATCH lines.
+    A line with here-docs is held as pending and the lines after it
+    fill them, with a "> " prompt, before it is executed.
+    The shell exits at the end of its input.
 */
 int main(int argc, char const *argv[]) {
 
     SIGINT_handler_wrapper();
     SIGCHLD_handler_wrapper();
-    SIGUSR1_handler_wrapper();
 
-    char buffer[BUFFER_SIZE];
+    LineReader reader;
+    bool interactive = open_input(&reader, argc, argv);
+    init_job_control(interactive);
+    History * history = shellHistory();
+    open_history(history);
+    LineEditor editor;
+    if (interactive) {
+        initEditor(&editor, history, PROMPT);
+        setInteractiveReader(&reader);
+    }
+    int epfd = -1;
+    if (reader.fd != -1) {
+        struct epoll_event event;
+        epfd = moveHigh(epoll_create1(EPOLL_CLOEXEC));
+        event.events = EPOLLIN;
+        event.data.fd = reader.fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, reader.fd, &event) == -1) {
+            close(epfd);
+            epfd = -1;
+        } else {
+            event.data.fd = SIGCHLD_fd();
+            epoll_ctl(epfd, EPOLL_CTL_ADD, SIGCHLD_fd(), &event);
+        }
+    }
+    unsigned long line_number = 0;
+    bool prompt = interactive;
+    Line *pending = NULL;
     while (true) {
-        fprintf(stdout, "## myshell $ ");
-        if (get_command(buffer)) {
-            char * input = strndup(buffer,strlen(buffer) - 1);
-            Line * line = parse(input);
-            if (line) {
-                timeX_flag=0;
-                execute(line);
+        if (prompt) {
+            fflush(stdout);
+            editor.prompt = pending != NULL ? CONTINUE_PROMPT : PROMPT;
+            startLine(&editor);
+            prompt = false;
+        }
+        char * buffer = interactive ? editLine(&editor, &reader) : takeLine(&reader);
+        if (buffer != nullptr) {
+            if (pending != NULL) {
+                feedHereDoc(pending, buffer);
+                if (!hereDocPending(pending)) {
+                    execute(pending);
+                    pending = NULL;
+                }
+            } else {
+                if (interactive) {
+                    addHistory(history, buffer);
+                }
+                Line * line = parse(buffer);
+                if (line && hereDocPending(line)) {
+                    pending = line;
+                } else if (line) {
+                    execute(line);
+                }
+            }
+            if (++line_number % REAP_BATCH == 0) {
+                reap_children();
             }
-            free(input);
+            prompt = interactive;
+        } else if (reader.eof) {
+            if (pending != NULL) {
+                fprintf(stderr, "myshell: here-document delimited by end-of-file\n");
+                execute(pending);
+            }
+            break;
+        } else {
+            bool reaped = false;
+            if (!wait_for_input(epfd, &reader, &reaped) || sigint_flag) {
+                sigint_flag = 0;
+                if (interactive) {
+                    fprintf(stdout, "\n");
+                    resetEditor(&editor);
+                }
+                if (pending != NULL) {
+                    freeLine(pending);
+                    pending = NULL;
+                }
+                prompt = interactive;
+            }
+            prompt = prompt || (interactive && reaped);
         }
-        cleanup_wrapper();
     }
+    if (interactive) {
+        fprintf(stdout, "\n");
+        freeEditor(&editor);
+    }
+    reap_children();
+    closeHistory(history);
+    freeReader(&reader);
+    return EXIT_SUCCESS;
 }
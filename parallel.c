@@ -0,0 +1,249 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include "execute.h"
+#include "input.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <wait.h>
+
+/*
+    ArgSource hands out the arguments of parallel, either the words
+    after ":::" or the lines of reader when it is not NULL.
+*/
+typedef struct ArgSource {
+    char **words;
+    int word_number;
+    int next;
+    LineReader *reader;
+} ArgSource;
+
+/*
+    returns the number of CPUs the shell may run on, which is the
+    default limit: more children than that would only time-share them.
+*/
+int available_cpus() {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+/*
+    next_arg returns the next non-empty argument, or NULL when there is
+    none left. A line read from the reader is valid until the next call,
+    and the reader is only refilled when no complete line is buffered.
+*/
+char *next_arg(ArgSource *source) {
+    if (source->reader == NULL) {
+        return source->next < source->word_number ? source->words[source->next++] : NULL;
+    }
+    while (true) {
+        char *line = takeLine(source->reader);
+        if (line != NULL) {
+            if (*line != '\0') {
+                return line;
+            }
+            continue;
+        }
+        if (source->reader->eof) {
+            return NULL;
+        }
+        fillReader(source->reader);
+    }
+}
+
+/*
+    substitute returns a new string which is word with every "{}"
+    replaced by arg.
+*/
+char *substitute(const char *word, const char *arg) {
+    size_t arg_length = strlen(arg);
+    size_t length = strlen(word);
+    size_t size = length + 1;
+    for (const char *found = strstr(word, "{}"); found != NULL; found = strstr(found + 2, "{}")) {
+        size += arg_length;
+    }
+    char *result = (char *)malloc(size);
+    char *output = result;
+    const char *input = word;
+    for (const char *found = strstr(input, "{}"); found != NULL; found = strstr(input, "{}")) {
+        memcpy(output, input, found - input);
+        output += found - input;
+        memcpy(output, arg, arg_length);
+        output += arg_length;
+        input = found + 2;
+    }
+    strcpy(output, input);
+    return result;
+}
+
+/*
+    launch spawns words with arg substituted for "{}", or appended if
+    no word contains it, as a process of job. When every earlier process
+    of the job has been reaped its process group is gone, so a new one
+    is started, which also takes the terminal again.
+*/
+pid_t launch(char **words, int word_number, const char *arg, Job *job) {
+    bool placeholder = false;
+    for (int i = 0; i < word_number; i++) {
+        placeholder = placeholder || strstr(words[i], "{}") != NULL;
+    }
+    char **argv = (char **)malloc(sizeof(char *) * (word_number + 2));
+    for (int i = 0; i < word_number; i++) {
+        argv[i] = placeholder && strstr(words[i], "{}") != NULL ? substitute(words[i], arg) : words[i];
+    }
+    int argc = word_number;
+    if (!placeholder) {
+        argv[argc++] = (char *)arg;
+    }
+    argv[argc] = NULL;
+    if (job->alive == 0) {
+        job->pgid = 0;
+    }
+    job->state = JOB_RUNNING;
+    Command command = {.argc = argc, .argv = argv, .next = NULL, .redirects = NULL, .placement = NULL};
+    pid_t pid = run_command(&command, -1, -1, job);
+    for (int i = 0; i < word_number; i++) {
+        if (argv[i] != words[i]) {
+            free(argv[i]);
+        }
+    }
+    free(argv);
+    return pid;
+}
+
+/*
+    parallel_builtin keeps up to N children of cmd running, N being the
+    number of usable CPUs unless "-j N" is given. Its arguments are the
+    words after ":::" or the lines read from in (-1 for the shell's own
+    stdin, which is read to the end first since the children own the
+    terminal meanwhile). Every child is reaped through reap_child(), so
+    a new one starts the moment one exits; a child killed by SIGINT
+    stops the launching of new ones. It prints the number of children,
+    how many failed and the wall time.
+*/
+void parallel_builtin(Command *cmd, int in, Job *job) {
+    int limit = available_cpus();
+    char **words = cmd->argv + 1;
+    int word_number = cmd->argc - 1;
+    if (word_number > 0 && strncmp(words[0], "-j", 2) == 0) {
+        const char *value = words[0][2] != '\0' ? words[0] + 2 : (word_number > 1 ? words[1] : "");
+        int shift = words[0][2] != '\0' ? 1 : 2;
+        char *end = NULL;
+        long number = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || number <= 0) {
+            fprintf(stderr, "myshell: parallel: invalid job number '%s'\n", value);
+            if (in != -1) {
+                close(in);
+            }
+            return;
+        }
+        limit = (int)number;
+        words += shift;
+        word_number -= shift;
+    }
+    ArgSource source = {NULL, 0, 0, NULL};
+    for (int i = 0; i < word_number; i++) {
+        if (strcmp(words[i], ":::") == 0) {
+            source.words = words + i + 1;
+            source.word_number = word_number - i - 1;
+            word_number = i;
+            break;
+        }
+    }
+    if (word_number == 0) {
+        fprintf(stderr, "myshell: parallel: missing command\n");
+        if (in != -1) {
+            close(in);
+        }
+        return;
+    }
+    LineReader reader;
+    if (source.words == NULL) {
+        initReader(&reader, in == -1 ? STDIN_FILENO : in);
+        source.reader = &reader;
+        while (in == -1 && !reader.eof) {
+            if (!fillReader(&reader)) {
+                freeReader(&reader);
+                return;
+            }
+        }
+    } else if (in != -1) {
+        close(in);
+    }
+
+    struct timespec begin;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    pid_t *running = (pid_t *)calloc(limit, sizeof(pid_t));
+    int running_number = 0;
+    int started = 0;
+    int failed = 0;
+    char *arg = next_arg(&source);
+    while (arg != NULL || running_number > 0) {
+        if (arg != NULL && running_number < limit) {
+            int slot = 0;
+            while (running[slot] != 0) {
+                ++slot;
+            }
+            pid_t pid = launch(words, word_number, arg, job);
+            ++started;
+            if (pid > 0) {
+                running[slot] = pid;
+                ++running_number;
+            } else {
+                ++failed;
+            }
+            arg = next_arg(&source);
+            continue;
+        }
+        int status;
+        pid_t pid = reap_child(-1, 0, &status);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (job->state == JOB_STOPPED) {
+            job->state = JOB_RUNNING;
+            kill(-job->pgid, SIGCONT);
+        }
+        if (WIFSTOPPED(status) || WIFCONTINUED(status)) {
+            continue;
+        }
+        int slot = 0;
+        while (slot < limit && running[slot] != pid) {
+            ++slot;
+        }
+        if (slot == limit) {
+            continue;
+        }
+        running[slot] = 0;
+        --running_number;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++failed;
+        }
+        if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT) {
+            arg = NULL;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(running);
+    if (source.reader != NULL) {
+        freeReader(&reader);
+    }
+    if (terminal_fd() != -1) {
+        tcsetpgrp(terminal_fd(), getpgrp());
+    }
+    double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    fprintf(stderr, "parallel: %d jobs, %d failed, %.3f s\n", started, failed, seconds);
+}
@@ -0,0 +1,12 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+#include "jobs.h"
+
+/*
+    "parallel [-j N] cmd ... {} ... [::: arg ...]" runs cmd once per
+    argument, substituting it for every "{}" (or appending it when
+    there is none), with at most N children running at once. The
+    arguments come after ":::" or, one per line, from in.
+*/
+void parallel_builtin(Command *cmd, int in, Job *job);
+#endif //PARALLEL_H
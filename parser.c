@@ -1,107 +1,601 @@
 #include "parser.h"
+#include "builtin.h"
+#include "capture.h"
+#include "wildcard.h"
+#include "limit.h"
+#include "placement.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 
 /*
-    it examines the line from argument begin to argument end
-    or when it meets |.
-    If there's a non-space string between begin and end and 
-    the string does not contains &, there's a command between
-    begin and end and returns the length of that command. Else
-    it means that there's an illegal command between begin and end
-    and thus returns -1.
+    Parser holds the state of the single pass over a line.
+    words collects the arguments of the command being scanned and
+    is kept between lines, so it only grows for unusually long
+    commands. tail is where the next Command of the current pipeline
+    is linked. Everything that outlives the pass is allocated from
+    the arena of the line.
 */
-int hasCmd(const char * line, const int begin, const int end) {
-    int i=begin;
-    bool hascmd=false;
-    while (i<end &&line[i] != '|') {
-        if (line[i]!=' '&&line[i]!='&') {
-            hascmd=true;
-        }
+typedef struct Parser {
+    Line * line;
+    Command ** tail;
+    bool pipePending;
+    bool inFanout;
+    bool fanoutClosed;
+    int branchCapacity;
+    Redirect * redirects;
+    Redirect ** redirectTail;
+    int redirectNumber;
+    Redirect ** hereDocTail;
+    bool expand;
+} Parser;
+
+static char ** words=nullptr;
+static int wordNumber=0;
+static int wordCapacity=0;
+
+bool isBlank(char c) {
+    return c==' '||c=='\t';
+}
+
+/*
+    returns true if only blanks and & follow position i,
+    i.e. the '}' at position i closes a fan-out.
+*/
+bool closesFanout(const char * input, size_t i) {
+    ++i;
+    while (isBlank(input[i])||input[i]=='&') {
         ++i;
     }
-    if (hascmd) {
-        return i;
-    } else {
-        return -1;
+    return input[i]=='\0';
+}
+
+void pushWord(Parser * parser, const char * input, size_t size) {
+    if (wordNumber==wordCapacity) {
+        wordCapacity=wordCapacity==0?32:wordCapacity*2;
+        words=(char**)realloc(words,sizeof(char*)*wordCapacity);
     }
+    words[wordNumber++]=arenaStrndup(parser->line->arena,input,size);
 }
 
+/*
+    It turns the collected words into a Command with an argv of
+    exactly argc+1 entries and links it into the current pipeline.
+    It returns false if there is no word, i.e. an empty command.
+*/
+bool finishCommand(Parser * parser) {
+    if (wordNumber==0) {
+        return false;
+    }
+    Arena * arena=parser->line->arena;
+    Command * cmd=(Command*)arenaAlloc(arena,sizeof(Command));
+    cmd->argc=wordNumber;
+    cmd->argv=(char**)arenaAlloc(arena,sizeof(char*)*(wordNumber+1));
+    memcpy(cmd->argv,words,sizeof(char*)*wordNumber);
+    cmd->argv[wordNumber]=nullptr;
+    cmd->next=nullptr;
+    cmd->redirects=parser->redirects;
+    cmd->placement=nullptr;
+    parser->redirects=nullptr;
+    parser->redirectTail=&parser->redirects;
+    parser->redirectNumber=0;
+    *parser->tail=cmd;
+    parser->tail=&cmd->next;
+    parser->pipePending=false;
+    wordNumber=0;
+    return true;
+}
 
 /*
-    It checks whether the use of pipe and background is correct.
-    It returns -1 if it is incorrect and BACKGROUND_MODE if it is in
-    background or FOREGROUND_MODE it if is in foreground.
+    It opens a new branch of the fan-out and makes it the
+    current pipeline.
 */
-int syntaxCheck(char * line) {
-    ssize_t size = strlen(line);
-    if(split_input(line, nullptr," ",false)==0) {
-        return -1;
+void startBranch(Parser * parser) {
+    Line * line=parser->line;
+    if (line->branchNumber==parser->branchCapacity) {
+        int capacity=parser->branchCapacity==0?4:parser->branchCapacity*2;
+        Command ** branch=(Command**)arenaAlloc(line->arena,sizeof(Command*)*capacity);
+        if (line->branchNumber!=0) {
+            memcpy(branch,line->branch,sizeof(Command*)*line->branchNumber);
+        }
+        line->branch=branch;
+        parser->branchCapacity=capacity;
     }
-    char * background = strchr(line,'&');
+    line->branch[line->branchNumber]=nullptr;
+    parser->tail=&line->branch[line->branchNumber];
+    ++line->branchNumber;
+}
 
-    // & check
-    if (background) {
-        if (background==line) {
-            fprintf(stderr,"myshell: syntax error near unexpected token '&'\n");
-            return -1;
+/*
+    It ends the current branch of the fan-out. It prints an
+    error and returns false if the branch is empty or ends with |.
+*/
+bool finishBranch(Parser * parser) {
+    bool pending=parser->pipePending;
+    if (!finishCommand(parser)) {
+        if (pending) {
+            fprintf(stderr,"myshell: Incomplete '|' sequence\n");
+        } else {
+            fprintf(stderr,"myshell: Empty branch in '|{' sequence\n");
         }
-        int before=(int)(background-line)-1;
-        bool emptyBefore=true;
-        while (before>=0) {
-            if (line[before]!=' ') {
-                emptyBefore=false;
-                break;
-            }
-            --before;
+        return false;
+    }
+    return true;
+}
+
+/*
+    returns true if a word ends at position i: at a blank, a pipe, an
+    &, a redirection or the '}' that closes a fan-out.
+*/
+bool endsWord(Parser * parser, const char * input, size_t i) {
+    char c=input[i];
+    return c=='\0'||isBlank(c)||c=='|'||c=='&'||c=='<'||c=='>'
+           ||(parser->inFanout&&c=='}'&&closesFanout(input,i));
+}
+
+/*
+    returns true if a command substitution, $( or `, starts at i.
+*/
+bool startsSubstitution(const char * input, size_t i) {
+    return (input[i]=='$'&&input[i+1]=='(')||input[i]=='`';
+}
+
+/*
+    It moves *position past the substitution starting there: past the
+    ')' matching "$(", counting the parentheses in between, or past
+    the next '`'. It prints an error and returns false if there is
+    none.
+*/
+bool skipSubstitution(const char * input, size_t * position) {
+    size_t i=*position;
+    if (input[i]=='`') {
+        const char * end=strchr(input+i+1,'`');
+        if (end==nullptr) {
+            fprintf(stderr,"myshell: unexpected end of line while looking for matching '`'\n");
+            return false;
         }
-        if (emptyBefore) {
-            fprintf(stderr,"myshell: syntax error near unexpected token '&'\n");
-            return -1;
+        *position=end-input+1;
+        return true;
+    }
+    int depth=0;
+    for (i+=1;input[i]!='\0';++i) {
+        if (input[i]=='(') {
+            ++depth;
+        } else if (input[i]==')'&&--depth==0) {
+            *position=i+1;
+            return true;
         }
-        int after = (int)(background-line)+1;
-        while (after<size) {
-            if (line[after]!=' ') {
-                fprintf(stderr,"myshell: '&' should not appear in the middle of the command line\n");
-                return -1;
+    }
+    fprintf(stderr,"myshell: unexpected end of line while looking for matching ')'\n");
+    return false;
+}
+
+/*
+    It moves *position to the end of the word starting there. Blanks
+    and operators inside a substitution belong to the word. A
+    substitution or a wildcard character marks the line for
+    expandLine().
+*/
+bool scanWord(Parser * parser, const char * input, size_t * position) {
+    size_t i=*position;
+    while (!endsWord(parser,input,i)) {
+        char c=input[i];
+        if (!startsSubstitution(input,i)) {
+            parser->expand=parser->expand||c=='*'||c=='?'||c=='[';
+            ++i;
+        } else if (skipSubstitution(input,&i)) {
+            parser->expand=true;
+        } else {
+            return false;
+        }
+    }
+    *position=i;
+    return true;
+}
+
+/*
+    returns true if a redirection starts at position i, i.e. there is
+    a '<' or '>' there or after a file descriptor number.
+*/
+bool startsRedirect(const char * input, size_t i) {
+    while (input[i]>='0'&&input[i]<='9') {
+        ++i;
+    }
+    return input[i]=='<'||input[i]=='>';
+}
+
+/*
+    It scans the redirection at *position: [n]< [n]> [n]>> [n]>&m,
+    <<< word and << delimiter, followed by its word, and appends it
+    to the redirections of the current command. A here-doc is also
+    linked to line->hereDocs so that its lines can be collected after
+    the line. Only fds below REDIRECT_FD_BASE can be redirected or
+    duplicated, as the shell keeps its own fds from there on. It
+    prints an error and returns false on a syntax error.
+*/
+bool lexRedirect(Parser * parser, const char * input, size_t * position) {
+    size_t i=*position;
+    int fd=-1;
+    if (input[i]>='0'&&input[i]<='9') {
+        fd=0;
+        while (input[i]>='0'&&input[i]<='9') {
+            fd=fd*10+input[i++]-'0';
+            if (fd>=REDIRECT_FD_BASE) {
+                fprintf(stderr,"myshell: file descriptor out of range, use 0-%d\n",REDIRECT_FD_BASE-1);
+                return false;
             }
-            ++after;
         }
     }
+    Redirect * redirect=(Redirect*)arenaAlloc(parser->line->arena,sizeof(Redirect));
+    redirect->source=-1;
+    redirect->memfd=-1;
+    redirect->complete=false;
+    redirect->next=nullptr;
+    redirect->nextHereDoc=nullptr;
+    if (input[i]=='<') {
+        if (input[i+1]=='<'&&input[i+2]=='<') {
+            redirect->type=REDIRECT_HERE_STRING;
+            i+=3;
+        } else if (input[i+1]=='<') {
+            redirect->type=REDIRECT_HERE_DOC;
+            i+=2;
+        } else {
+            redirect->type=REDIRECT_INPUT;
+            ++i;
+        }
+        redirect->fd=fd==-1?0:fd;
+    } else {
+        if (input[i+1]=='>') {
+            redirect->type=REDIRECT_APPEND;
+            i+=2;
+        } else if (input[i+1]=='&') {
+            redirect->type=REDIRECT_DUP;
+            i+=2;
+        } else {
+            redirect->type=REDIRECT_OUTPUT;
+            ++i;
+        }
+        redirect->fd=fd==-1?1:fd;
+    }
+    while (isBlank(input[i])) {
+        ++i;
+    }
+    size_t begin=i;
+    if (!scanWord(parser,input,&i)) {
+        return false;
+    }
+    if (i==begin) {
+        if (input[i]=='\0') {
+            fprintf(stderr,"myshell: syntax error near unexpected token 'newline'\n");
+        } else {
+            fprintf(stderr,"myshell: syntax error near unexpected token '%c'\n",input[i]);
+        }
+        return false;
+    }
+    redirect->word=arenaStrndup(parser->line->arena,input+begin,i-begin);
+    if (redirect->type==REDIRECT_DUP) {
+        char * end=nullptr;
+        redirect->source=(int)strtol(redirect->word,&end,10);
+        if (*end!='\0'||redirect->source<0) {
+            fprintf(stderr,"myshell: %s: '>&' needs a file descriptor\n",redirect->word);
+            return false;
+        }
+        if (redirect->source>=REDIRECT_FD_BASE) {
+            fprintf(stderr,"myshell: file descriptor out of range, use 0-%d\n",REDIRECT_FD_BASE-1);
+            return false;
+        }
+    }
+    if (parser->redirectNumber==REDIRECT_MAX) {
+        fprintf(stderr,"myshell: more than %d redirections in a command\n",REDIRECT_MAX);
+        return false;
+    }
+    ++parser->redirectNumber;
+    *parser->redirectTail=redirect;
+    parser->redirectTail=&redirect->next;
+    if (redirect->type==REDIRECT_HERE_DOC) {
+        *parser->hereDocTail=redirect;
+        parser->hereDocTail=&redirect->nextHereDoc;
+    }
+    *position=i;
+    return true;
+}
 
-    // | check
-    char * pipe = strchr(line, '|');
-    if (pipe!=nullptr) {
-        int itr = hasCmd(line,0,(int)(pipe-line));
-        if (itr==-1||line[size-1]=='|') {
-            fprintf(stderr,"myshell: Incomplete '|' sequence\n");
-            return -1;
+/*
+    It scans input once and builds the Line directly:
+    blanks separate words, | separates commands, |{ opens a fan-out
+    whose branches are separated by a standalone ',' and which is
+    closed by the last '}', redirections go to the command they are
+    written in, a $(...) or `...` stays inside its word whatever it
+    contains, and a trailing & puts the line into background. It
+    prints an error and returns false on a syntax error.
+*/
+bool lex(Parser * parser, const char * input) {
+    Line * line=parser->line;
+    size_t i=0;
+    while (true) {
+        while (isBlank(input[i])) {
+            ++i;
         }
-        while (itr!=size)  {
-            itr = hasCmd(line,itr+1,(int)size);
-            if (itr==-1) {
+        char c=input[i];
+        if (line->background&&c!='\0') {
+            fprintf(stderr,"myshell: '&' should not appear in the middle of the command line\n");
+            return false;
+        }
+        if (parser->fanoutClosed&&c!='\0'&&c!='&') {
+            fprintf(stderr,"myshell: '|{' must be the last stage of the command line\n");
+            return false;
+        }
+        if (c=='\0') {
+            break;
+        } else if (c=='&') {
+            if (line->head==nullptr&&wordNumber==0) {
+                fprintf(stderr,"myshell: syntax error near unexpected token '&'\n");
+                return false;
+            }
+            line->background=BACKGROUND_MODE;
+            ++i;
+        } else if (c=='|') {
+            bool fanout=(input[i+1]=='{');
+            if (parser->inFanout&&fanout) {
+                fprintf(stderr,"myshell: Nested '|{' is not supported\n");
+                return false;
+            }
+            if (!finishCommand(parser)) {
                 fprintf(stderr,"myshell: Incomplete '|' sequence\n");
-                return -1;
+                return false;
+            }
+            if (fanout) {
+                parser->inFanout=true;
+                startBranch(parser);
+                i+=2;
+            } else {
+                parser->pipePending=true;
+                ++i;
+            }
+        } else if (parser->inFanout&&c==','&&(isBlank(input[i+1])||input[i+1]=='\0')) {
+            if (!finishBranch(parser)) {
+                return false;
             }
+            startBranch(parser);
+            ++i;
+        } else if (parser->inFanout&&c=='}'&&closesFanout(input,i)) {
+            if (!finishBranch(parser)) {
+                return false;
+            }
+            parser->inFanout=false;
+            parser->fanoutClosed=true;
+            ++i;
+        } else if (startsRedirect(input,i)) {
+            if (!lexRedirect(parser,input,&i)) {
+                return false;
+            }
+        } else {
+            size_t begin=i;
+            if (!scanWord(parser,input,&i)) {
+                return false;
+            }
+            pushWord(parser,input+begin,i-begin);
         }
     }
-    if (background!=nullptr) {
-        return BACKGROUND_MODE;
-    } else {
-        return FOREGROUND_MODE;
+    if (parser->inFanout) {
+        fprintf(stderr,"myshell: Missing '}' in '|{' sequence\n");
+        return false;
+    }
+    if (parser->fanoutClosed) {
+        return true;
+    }
+    bool pending=parser->pipePending;
+    if (!finishCommand(parser)&&pending) {
+        fprintf(stderr,"myshell: Incomplete '|' sequence\n");
+        return false;
+    }
+    if (parser->redirects!=nullptr) {
+        fprintf(stderr,"myshell: redirection without a command\n");
+        return false;
+    }
+    return line->head!=nullptr;
+}
+
+bool hasSubstitution(const char * word) {
+    return strchr(word,'`')!=nullptr||strstr(word,"$(")!=nullptr;
+}
+
+/*
+    expandWord appends word to text with every substitution replaced
+    by the output of its command, which runs right away. It returns
+    false if a command could not be run.
+*/
+bool expandWord(const char * word, TextBuffer * text) {
+    size_t i=0;
+    while (word[i]!='\0') {
+        size_t begin=i;
+        while (word[i]!='\0'&&!startsSubstitution(word,i)) {
+            ++i;
+        }
+        appendText(text,word+begin,i-begin);
+        if (word[i]=='\0') {
+            break;
+        }
+        size_t end=i;
+        skipSubstitution(word,&end);
+        begin=word[i]=='`'?i+1:i+2;
+        char * command=strndup(word+begin,end-1-begin);
+        Capture capture;
+        bool captured=captureOutput(command,&capture);
+        free(command);
+        appendText(text,capture.output.data,capture.output.size);
+        freeText(&capture.output);
+        if (!captured) {
+            return false;
+        }
+        i=end;
+    }
+    return true;
+}
+
+void pushArgument(char *** argv, int * argc, int * capacity, char * word) {
+    if (*argc+1>=*capacity) {
+        *capacity*=2;
+        *argv=(char**)realloc(*argv,sizeof(char*)*(*capacity));
+    }
+    (*argv)[(*argc)++]=word;
+}
+
+/*
+    splitWords appends the blank or newline separated fields of text
+    to *fields, growing it as needed, and returns their new number.
+*/
+int splitWords(Arena * arena, TextBuffer * text, char *** fields, int number, int * capacity) {
+    size_t i=0;
+    while (true) {
+        while (i<text->size&&(isBlank(text->data[i])||text->data[i]=='\n')) {
+            ++i;
+        }
+        if (i==text->size) {
+            return number;
+        }
+        size_t begin=i;
+        while (i<text->size&&!isBlank(text->data[i])&&text->data[i]!='\n') {
+            ++i;
+        }
+        pushArgument(fields,&number,capacity,arenaStrndup(arena,text->data+begin,i-begin));
+    }
+}
+
+/*
+    addArgument appends word to *argv, or the sorted paths it matches
+    if it is a pattern which matches any. The paths are copied into
+    the arena in one piece.
+*/
+void addArgument(Arena * arena, WildcardMatches * matches, char * word, char *** argv, int * argc, int * capacity) {
+    size_t number=0;
+    if (hasWildcard(word)) {
+        matches->number=0;
+        matches->names.size=0;
+        number=expandWildcard(word,matches);
+    }
+    if (number==0) {
+        pushArgument(argv,argc,capacity,word);
+        return;
+    }
+    char * names=(char*)arenaAlloc(arena,matches->names.size);
+    memcpy(names,matches->names.data,matches->names.size);
+    size_t i=0;
+    for (i=0;i!=number;++i) {
+        pushArgument(argv,argc,capacity,names+matches->offsets[i]);
+    }
+}
+
+/*
+    expandCommand replaces the substitutions in the arguments and
+    redirection words of cmd. An argument is split into fields on
+    blanks and newlines, then every field which is a pattern is
+    replaced by the paths it matches; argv grows as needed. A file
+    name must stay one field. It prints an error and returns false if
+    a substitution fails.
+*/
+bool expandCommand(Arena * arena, Command * cmd) {
+    int capacity=cmd->argc+1;
+    char ** argv=(char**)malloc(sizeof(char*)*capacity);
+    int argc=0;
+    int fieldCapacity=8;
+    char ** fields=(char**)malloc(sizeof(char*)*fieldCapacity);
+    WildcardMatches matches;
+    initMatches(&matches);
+    int i=0;
+    bool expanded=true;
+    TextBuffer text;
+    initText(&text);
+    for (i=0;i!=cmd->argc&&expanded;++i) {
+        if (!hasSubstitution(cmd->argv[i])) {
+            addArgument(arena,&matches,cmd->argv[i],&argv,&argc,&capacity);
+            continue;
+        }
+        text.size=0;
+        expanded=expandWord(cmd->argv[i],&text);
+        int number=splitWords(arena,&text,&fields,0,&fieldCapacity);
+        int j=0;
+        for (j=0;j!=number;++j) {
+            addArgument(arena,&matches,fields[j],&argv,&argc,&capacity);
+        }
+    }
+    Redirect * redirect=cmd->redirects;
+    for (;redirect!=nullptr&&expanded;redirect=redirect->next) {
+        if (redirect->type==REDIRECT_DUP||redirect->type==REDIRECT_HERE_DOC||!hasSubstitution(redirect->word)) {
+            continue;
+        }
+        text.size=0;
+        expanded=expandWord(redirect->word,&text);
+        if (redirect->type==REDIRECT_HERE_STRING) {
+            redirect->word=arenaStrndup(arena,text.data,text.size);
+        } else if (splitWords(arena,&text,&fields,0,&fieldCapacity)==1) {
+            redirect->word=fields[0];
+        } else if (expanded) {
+            fprintf(stderr,"myshell: %s: ambiguous redirect\n",redirect->word);
+            expanded=false;
+        }
+    }
+    freeText(&text);
+    freeMatches(&matches);
+    free(fields);
+    cmd->argv=(char**)arenaAlloc(arena,sizeof(char*)*(argc+1));
+    memcpy(cmd->argv,argv,sizeof(char*)*argc);
+    cmd->argv[argc]=nullptr;
+    cmd->argc=argc;
+    free(argv);
+    return expanded;
+}
+
+/*
+    expandLine runs the command substitutions and expands the
+    patterns of every command of line, in the order they were
+    written, before the line itself runs. A command whose arguments
+    all expand to nothing is dropped if it is the whole line, as
+    there is nothing to run; in a pipeline it is an error.
+*/
+bool expandLine(Line * line) {
+    int branch=-1;
+    for (branch=-1;branch<line->branchNumber;++branch) {
+        Command * cmd=branch==-1?line->head:line->branch[branch];
+        for (;cmd!=nullptr;cmd=cmd->next) {
+            if (!expandCommand(line->arena,cmd)) {
+                return false;
+            }
+            if (cmd->argc!=0) {
+                continue;
+            }
+            if (cmd!=line->head||cmd->next!=nullptr||line->branchNumber!=0) {
+                fprintf(stderr,"myshell: empty command after substitution\n");
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+    isBenchLine tells whether line runs the bench built-in, i.e.
+    whether its first word after the "@" modifiers is "bench". It is
+    asked before expansion, so the words are compared as written.
+*/
+bool isBenchLine(Line * line) {
+    Command * first=line->head;
+    int i=0;
+    while (i<first->argc&&first->argv[i][0]=='@') {
+        ++i;
     }
+    return i<first->argc&&strcmp(first->argv[i],"bench\0")==0;
 }
 
 /*
-    It checks whether the use of exit and viewtree is correct.
-    They cannot have arguments or pipe or be run in background.
+    It checks whether the use of exit is correct.
+    It cannot have arguments or pipe or be run in background.
     If it is incorrect, print corresponding error message to stderr
     and returns nullptr. Else returns line directly.
 */
 Line * process(Line * line, char * message) {
-    if (line->head->argc!=1||line->head->next!=nullptr||line->background) {
+    if (line->head->argc!=1||line->head->next!=nullptr||line->branchNumber!=0||line->background) {
         fprintf(stderr,"myshell: \"%s\" with other arguments!!!\n",message);
         freeLine(line);
         return nullptr;
@@ -110,19 +604,81 @@ Line * process(Line * line, char * message) {
     }
 }
 
+/*
+    It checks that a built-in which runs inside the shell, such as
+    hash or the job control commands, is neither piped nor run in
+    background. Returns nullptr after printing an error otherwise.
+*/
+Line * standalone(Line * line, int type, char * message) {
+    if (line->head->next!=nullptr||line->branchNumber!=0||line->background) {
+        fprintf(stderr,"myshell: \"%s\" cannot be piped or run in background\n",message);
+        freeLine(line);
+        return nullptr;
+    }
+    line->type=type;
+    return line;
+}
+
 /*
     It checks the use of built-in command and set the
     corresponding type. If there' illegal usage, returns
     nullptr else returns the line with line->type set.
+    A command of the built-in table (cd, echo, test...) standing
+    alone gets BUILTIN_TYPE and runs in the shell; piped or in
+    background it stays a normal command and runs in the child.
+    "limit" and its options are removed first and kept in
+    line->limits; the command it limits is then checked the same
+    way, except that a built-in of the table runs in a child, where
+    the limits apply, and the other built-ins can not be limited.
+    The same goes for a command placed with "@" modifiers.
 */
 Line * processBuiltin(Line * line) {
     Command * first = line->head;
+    if (strcmp(first->argv[0],"limit\0")==0) { //limit built-in
+        line->limits=(ResourceLimits*)arenaAlloc(line->arena,sizeof(ResourceLimits));
+        if (!parseLimits(&first->argc,&first->argv,line->limits)) {
+            freeLine(line);
+            return nullptr;
+        }
+    }
+    if (line->limits!=nullptr||first->placement!=nullptr||line->spread) {
+        const char * special[]={"exit","viewtree","hash","jobs","fg","bg","wait","history","bench","limit"};
+        for (size_t i=0;i!=sizeof(special)/sizeof(special[0]);++i) {
+            if (strcmp(first->argv[0],special[i])==0) {
+                fprintf(stderr,"myshell: \"%s\" cannot be limited or placed\n",first->argv[0]);
+                freeLine(line);
+                return nullptr;
+            }
+        }
+    }
     if (strcmp(first->argv[0],"exit\0")==0) { // exit built-in
         line->type=EXIT_TYPE;
         return process(line,"exit\0");
     } else if (strcmp(first->argv[0],"viewtree\0")==0) { //viewtree built-in
-        line->type=VIEWTREE_TYPE;
-        return process(line,"viewtree\0");
+        return standalone(line,VIEWTREE_TYPE,"viewtree\0");
+    } else if (strcmp(first->argv[0],"hash\0")==0) { //hash built-in
+        return standalone(line,HASH_TYPE,"hash\0");
+    } else if (strcmp(first->argv[0],"jobs\0")==0) { //jobs built-in
+        return standalone(line,JOBS_TYPE,"jobs\0");
+    } else if (strcmp(first->argv[0],"fg\0")==0) { //fg built-in
+        return standalone(line,FG_TYPE,"fg\0");
+    } else if (strcmp(first->argv[0],"bg\0")==0) { //bg built-in
+        return standalone(line,BG_TYPE,"bg\0");
+    } else if (strcmp(first->argv[0],"wait\0")==0) { //wait built-in
+        return standalone(line,WAIT_TYPE,"wait\0");
+    } else if (strcmp(first->argv[0],"history\0")==0) { //history built-in
+        return standalone(line,HISTORY_TYPE,"history\0");
+    } else if (strcmp(first->argv[0],"bench\0")==0) { //bench built-in
+        if (line->background) {
+            fprintf(stderr,"myshell: \"bench\" cannot be run in background mode\n");
+            freeLine(line);
+            return nullptr;
+        }
+        line->type=BENCH_TYPE;
+        return line;
+    } else if (first->next==nullptr&&line->branchNumber==0&&!line->background&&line->limits==nullptr&&first->placement==nullptr&&!line->spread&&findBuiltin(first->argv[0])!=nullptr) {
+        line->type=BUILTIN_TYPE;
+        return line;
     }
     Command * iterator=line->head;
     if (strcmp(iterator->argv[0],"timeX\0")==0) { //timeX built-in
@@ -137,77 +693,85 @@ Line * processBuiltin(Line * line) {
             return nullptr;
         }
         --iterator->argc;
-        int i=0;
-        free(iterator->argv[0]);
-        for (i=0;i!=iterator->argc;++i) {
-            iterator->argv[i]=iterator->argv[i+1];
+        ++iterator->argv;
+        if (strcmp(iterator->argv[0],"-e\0")==0) { // timeX -e events
+            if (iterator->argc<3) {
+                fprintf(stderr,"myshell: \"timeX -e\" needs a list of events and a command\n");
+                freeLine(line);
+                return nullptr;
+            }
+            line->events=iterator->argv[1];
+            iterator->argc-=2;
+            iterator->argv+=2;
         }
-        iterator->argv[i]=nullptr;
         line->type=TIMEX_TYPE;
     } else { // no built-in function.
         line->type=NORMAL_TYPE;
     }
-    return line;
-}
-
-
-/*
-    It parses a command from input, splits it input argv and 
-    set the argc using space as its delimiter. 
-    It removes & if encounters and return the parsed command;
-*/
-Command * parseCommand(char * input) {
-    Command * result = (Command *)malloc(sizeof(Command));
-    result->argc=split_input(input,result->argv," ",true);
-    result->argv[result->argc]=nullptr;
-    if (strcmp(result->argv[result->argc-1],"&\0")==0) {
-        free(result->argv[--result->argc]);
-        result->argv[result->argc]=nullptr;
-    } else {
-        char * last = result->argv[result->argc-1];
-        size_t size = strlen(last);
-        if (last[size-1]=='&') {
-            last[size-1]='\0';
+    while (iterator->next!=nullptr) {
+        iterator=iterator->next;
+    }
+    if (line->type==NORMAL_TYPE&&strcmp(iterator->argv[0],"parallel\0")==0) { //parallel built-in
+        if (line->branchNumber!=0||line->background||iterator->placement!=nullptr) {
+            fprintf(stderr,"myshell: \"parallel\" cannot be followed by '|{', placed or run in background\n");
+            freeLine(line);
+            return nullptr;
         }
+        line->type=PARALLEL_TYPE;
     }
-    result->next=nullptr;
-    return result;
+    return line;
 }
 
 
+
 /*
     It parses a line into a parsed Line structure.
-    Firstly it does syntax check to check the usage of
-    pipe and background and set the flag correspondingly.
-     secondly it splits the line into
-    5 or fewer raw commands and uses these raw commands to create
-    a Command linked list. Finally it processes the built-in function
-    and returns the result.
-*/
-Line * parse(char * line) {
-    int i=0;
-    int syntaxResult = syntaxCheck(line);
-    if (syntaxResult==-1) {
+    lex() scans the line once, checking the usage of pipe, fan-out
+    and background while it creates the Command linked list; every
+    token and node comes from one arena that freeLine() releases in
+    one step. The text of the line, without the trailing '&', is kept
+    as line->text for the job table. If the line ends with a fan-out
+    "producer |{ consumerA , consumerB }", the consumers are parsed into
+    line->branch. The command substitutions $(...) and `...` are run
+    and the patterns with *, ?, [...] or ** expanded next by
+    expandLine(), except on a bench line, whose command is expanded
+    on every run, and the "@" modifiers of every command are then
+    removed by processModifiers(). Finally it processes the built-in
+    function and returns the result.
+*/
+Line * parse(char * input) {
+    Arena * arena=newArena();
+    Line * result=(Line*)arenaAlloc(arena,sizeof(Line));
+    result->arena=arena;
+    result->type=0;
+    result->events=nullptr;
+    result->background=FOREGROUND_MODE;
+    result->head=nullptr;
+    result->branchNumber=0;
+    result->branch=nullptr;
+    result->hereDocs=nullptr;
+    result->limits=nullptr;
+    result->spread=false;
+    Parser parser={result,&result->head,false,false,false,0,nullptr,nullptr,0,&result->hereDocs,false};
+    parser.redirectTail=&parser.redirects;
+    wordNumber=0;
+    size_t begin=0;
+    size_t end=strlen(input);
+    while (begin<end&&isBlank(input[begin])) {
+        ++begin;
+    }
+    while (end>begin&&(isBlank(input[end-1])||input[end-1]=='&')) {
+        --end;
+    }
+    result->text=arenaStrndup(arena,input+begin,end-begin);
+    if (!lex(&parser,input)) {
+        freeLine(result);
         return nullptr;
     }
-    Line * result = (Line*)malloc(sizeof(Line));
-    result->type=0;
-    result->background=syntaxResult;
-    char * rawCmd[5];
-    int cmdNumber = split_input(line,rawCmd,"|",true);
-    Command *iterator = nullptr;
-    while (i<cmdNumber) {
-        if (iterator==nullptr) {
-            result->head=parseCommand(rawCmd[i]);
-            iterator=result->head;
-        } else {
-            iterator->next=parseCommand(rawCmd[i]);
-            iterator=iterator->next;
-        }
-        free(rawCmd[i]);
-        rawCmd[i]=nullptr;
-        ++i;
+    // bench re-parses its command for every run, which expands it then.
+    if ((parser.expand&&!isBenchLine(result)&&!expandLine(result))||!processModifiers(result)) {
+        freeLine(result);
+        return nullptr;
     }
-    result = processBuiltin(result);
-    return result;
-}
\ No newline at end of file
+    return processBuiltin(result);
+}
@@ -0,0 +1,233 @@
+#include "pathcache.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/*
+    PathEntry caches where a command name was found. dir is the
+    index of its directory in PATH, i.e. the number of execve()
+    attempts execvp() would have failed before reaching it.
+*/
+typedef struct PathEntry {
+    char * name;
+    char * path;
+    int dir;
+    unsigned long hits;
+    struct PathEntry * next;
+} PathEntry;
+
+/*
+    PathDir is one directory of PATH and its mtime when the cache
+    was (re)built. Adding or removing a file changes the mtime.
+*/
+typedef struct PathDir {
+    char * path;
+    struct timespec mtime;
+} PathDir;
+
+static PathEntry * table[PATH_CACHE_BUCKETS];
+static char * cachedPATH=nullptr;
+static PathDir * dirs=nullptr;
+static int dirNumber=0;
+static struct timespec lastCheck;
+
+unsigned int hashName(const char * name) {
+    unsigned int hash=2166136261u;
+    while (*name) {
+        hash=(hash^(unsigned char)*name++)*16777619u;
+    }
+    return hash%PATH_CACHE_BUCKETS;
+}
+
+void statDir(PathDir * dir) {
+    struct stat info;
+    if (stat(dir->path,&info)==0) {
+        dir->mtime=info.st_mtim;
+    } else {
+        dir->mtime.tv_sec=-1;
+        dir->mtime.tv_nsec=0;
+    }
+}
+
+/*
+    clearCache drops every entry and records the current PATH and
+    the mtime of each of its directories. An empty element of PATH
+    stands for the current directory, as in execvp().
+*/
+void clearCache() {
+    int i=0;
+    for (i=0;i!=PATH_CACHE_BUCKETS;++i) {
+        PathEntry * entry=table[i];
+        while (entry) {
+            PathEntry * next=entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            entry=next;
+        }
+        table[i]=nullptr;
+    }
+    for (i=0;i!=dirNumber;++i) {
+        free(dirs[i].path);
+    }
+    free(dirs);
+    free(cachedPATH);
+    const char * path=getenv("PATH");
+    cachedPATH=strdup(path?path:"/bin:/usr/bin");
+    dirNumber=1;
+    const char * iterator=cachedPATH;
+    for (;*iterator;++iterator) {
+        dirNumber+=(*iterator==':');
+    }
+    dirs=(PathDir*)malloc(sizeof(PathDir)*dirNumber);
+    const char * begin=cachedPATH;
+    for (i=0;i!=dirNumber;++i) {
+        const char * end=strchr(begin,':');
+        size_t size=end?(size_t)(end-begin):strlen(begin);
+        dirs[i].path=size==0?strdup("."):strndup(begin,size);
+        statDir(&dirs[i]);
+        begin=end?end+1:begin+size;
+    }
+    clock_gettime(CLOCK_MONOTONIC_COARSE,&lastCheck);
+}
+
+bool dirChanged(PathDir * dir) {
+    struct timespec old=dir->mtime;
+    statDir(dir);
+    return old.tv_sec!=dir->mtime.tv_sec||old.tv_nsec!=dir->mtime.tv_nsec;
+}
+
+/*
+    returns false if PATH changed or a directory changed, i.e. the
+    cached answer may be stale. The directory of the entry (dir, -1
+    for none) is checked every time. The others, where a new file
+    could shadow the entry, are checked at most every
+    PATH_CACHE_RECHECK_MS, so a hit costs one stat() instead of one
+    failed execve() per earlier directory.
+*/
+bool cacheValid(int dir) {
+    const char * path=getenv("PATH");
+    if (cachedPATH==nullptr||strcmp(cachedPATH,path?path:"/bin:/usr/bin")!=0) {
+        return false;
+    }
+    if (dir>=0&&dirChanged(&dirs[dir])) {
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE,&now);
+    long elapsed=(now.tv_sec-lastCheck.tv_sec)*1000+(now.tv_nsec-lastCheck.tv_nsec)/1000000;
+    if (elapsed<PATH_CACHE_RECHECK_MS) {
+        return true;
+    }
+    lastCheck=now;
+    int i=0;
+    for (i=0;i!=dirNumber;++i) {
+        if (i!=dir&&dirChanged(&dirs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PathEntry * findEntry(const char * name) {
+    PathEntry * entry=table[hashName(name)];
+    while (entry&&strcmp(entry->name,name)!=0) {
+        entry=entry->next;
+    }
+    return entry;
+}
+
+/*
+    It walks PATH like execvp() does, but with stat() instead of
+    execve(), and caches the first executable regular file found.
+*/
+PathEntry * searchPath(const char * name) {
+    int i=0;
+    for (i=0;i!=dirNumber;++i) {
+        size_t size=strlen(dirs[i].path)+strlen(name)+2;
+        char * path=(char*)malloc(size);
+        snprintf(path,size,"%s/%s",dirs[i].path,name);
+        struct stat info;
+        if (stat(path,&info)==0&&S_ISREG(info.st_mode)&&access(path,X_OK)==0) {
+            PathEntry * entry=(PathEntry*)malloc(sizeof(PathEntry));
+            unsigned int bucket=hashName(name);
+            entry->name=strdup(name);
+            entry->path=path;
+            entry->dir=i;
+            entry->hits=0;
+            entry->next=table[bucket];
+            table[bucket]=entry;
+            return entry;
+        }
+        free(path);
+    }
+    return nullptr;
+}
+
+PathEntry * lookupEntry(const char * name) {
+    if (cachedPATH==nullptr) {
+        clearCache();
+    }
+    PathEntry * entry=findEntry(name);
+    if (entry!=nullptr&&!cacheValid(entry->dir)) {
+        clearCache();
+        entry=nullptr;
+    } else if (entry==nullptr&&!cacheValid(-1)) {
+        clearCache();
+    }
+    if (entry==nullptr) {
+        entry=searchPath(name);
+    }
+    return entry;
+}
+
+/*
+    resolveCommand returns the absolute path the command name runs
+    from, using and filling the cache. Names containing a '/' are not
+    looked up. It returns nullptr if name is not found in PATH. The
+    result stays valid until the next call.
+*/
+const char * resolveCommand(const char * name) {
+    if (strchr(name,'/')!=nullptr) {
+        return name;
+    }
+    PathEntry * entry=lookupEntry(name);
+    if (entry==nullptr) {
+        return nullptr;
+    }
+    ++entry->hits;
+    return entry->path;
+}
+
+/*
+    hash lists the cached commands with how often they were run and
+    how many failed execve() attempts the cache saved, "hash -r"
+    clears the cache and "hash name..." looks names up in advance.
+*/
+void hashBuiltin(int argc, char ** argv) {
+    if (argc==2&&strcmp(argv[1],"-r")==0) {
+        clearCache();
+        return;
+    }
+    int i=1;
+    for (i=1;i<argc;++i) {
+        if (lookupEntry(argv[i])==nullptr) {
+            fprintf(stderr,"myshell: hash: %s: not found\n",argv[i]);
+        }
+    }
+    if (argc>1) {
+        return;
+    }
+    printf("%-10s%-10s%-15s%s\n","HITS","SAVED","CMD","PATH");
+    for (i=0;i!=PATH_CACHE_BUCKETS;++i) {
+        PathEntry * entry=table[i];
+        for (;entry;entry=entry->next) {
+            printf("%-10lu%-10lu%-15s%s\n",entry->hits,entry->hits*entry->dir,entry->name,entry->path);
+        }
+    }
+    fflush(stdout);
+}
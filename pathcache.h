@@ -0,0 +1,7 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+#define PATH_CACHE_BUCKETS 256
+#define PATH_CACHE_RECHECK_MS 1000
+const char * resolveCommand(const char * name);
+void hashBuiltin(int argc, char ** argv);
+#endif //PATHCACHE_H
@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include "perfevent.h"
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+/*
+    PerfEvent describes an event "timeX -e" knows. A hardware event
+    whose PMU is missing, as in most VMs, is counted with fallback
+    instead when it has a software equivalent (-1 if not).
+*/
+typedef struct PerfEvent {
+    const char * name;
+    unsigned type;
+    unsigned long long config;
+    int fallback;
+} PerfEvent;
+
+static const PerfEvent perfEvents[]={
+    {"task-clock",PERF_TYPE_SOFTWARE,PERF_COUNT_SW_TASK_CLOCK,-1},
+    {"cpu-clock",PERF_TYPE_SOFTWARE,PERF_COUNT_SW_CPU_CLOCK,-1},
+    {"page-faults",PERF_TYPE_SOFTWARE,PERF_COUNT_SW_PAGE_FAULTS,-1},
+    {"minor-faults",PERF_TYPE_SOFTWARE,PERF_COUNT_SW_PAGE_FAULTS_MIN,-1},
+    {"major-faults",PERF_TYPE_SOFTWARE,PERF_COUNT_SW_PAGE_FAULTS_MAJ,-1},
+    {"context-switches",PERF_TYPE_SOFTWARE,PERF_COUNT_SW_CONTEXT_SWITCHES,-1},
+    {"cpu-migrations",PERF_TYPE_SOFTWARE,PERF_COUNT_SW_CPU_MIGRATIONS,-1},
+    {"cycles",PERF_TYPE_HARDWARE,PERF_COUNT_HW_CPU_CYCLES,1},
+    {"instructions",PERF_TYPE_HARDWARE,PERF_COUNT_HW_INSTRUCTIONS,-1},
+    {"cache-references",PERF_TYPE_HARDWARE,PERF_COUNT_HW_CACHE_REFERENCES,-1},
+    {"cache-misses",PERF_TYPE_HARDWARE,PERF_COUNT_HW_CACHE_MISSES,-1},
+    {"branches",PERF_TYPE_HARDWARE,PERF_COUNT_HW_BRANCH_INSTRUCTIONS,-1},
+    {"branch-misses",PERF_TYPE_HARDWARE,PERF_COUNT_HW_BRANCH_MISSES,-1},
+};
+
+#define PERF_EVENT_NUMBER ((int)(sizeof(perfEvents)/sizeof(perfEvents[0])))
+
+/*
+    parseEvents fills set from a comma separated list of event names.
+    It prints an error and returns false on an unknown name.
+*/
+bool parseEvents(const char * list, PerfEventSet * set) {
+    set->number=0;
+    const char * begin=list;
+    while (true) {
+        const char * end=strchrnul(begin,',');
+        int i=0;
+        while (i<PERF_EVENT_NUMBER&&(strlen(perfEvents[i].name)!=(size_t)(end-begin)||strncmp(perfEvents[i].name,begin,end-begin)!=0)) {
+            ++i;
+        }
+        if (i==PERF_EVENT_NUMBER) {
+            fprintf(stderr,"myshell: timeX: unknown event '%.*s'\n",(int)(end-begin),begin);
+            return false;
+        }
+        if (set->number==PERF_MAX_EVENTS) {
+            fprintf(stderr,"myshell: timeX: at most %d events\n",PERF_MAX_EVENTS);
+            return false;
+        }
+        set->events[set->number++]=i;
+        if (*end=='\0') {
+            return true;
+        }
+        begin=end+1;
+    }
+}
+
+/*
+    openEvent opens a counter of event for pid which starts at its
+    exec (enable_on_exec) and also counts every process it creates
+    (inherit). Kernel and hypervisor time is excluded when we are not
+    allowed to count it.
+*/
+int openEvent(const PerfEvent * event, pid_t pid) {
+    struct perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.size=sizeof(attr);
+    attr.type=event->type;
+    attr.config=event->config;
+    attr.disabled=1;
+    attr.enable_on_exec=1;
+    attr.inherit=1;
+    attr.read_format=PERF_FORMAT_TOTAL_TIME_ENABLED|PERF_FORMAT_TOTAL_TIME_RUNNING;
+    int fd=syscall(SYS_perf_event_open,&attr,pid,-1,-1,PERF_FLAG_FD_CLOEXEC);
+    if (fd==-1&&(errno==EACCES||errno==EPERM)) {
+        attr.exclude_kernel=1;
+        attr.exclude_hv=1;
+        fd=syscall(SYS_perf_event_open,&attr,pid,-1,-1,PERF_FLAG_FD_CLOEXEC);
+    }
+    return moveHigh(fd);
+}
+
+/*
+    openCounters opens every event of set for pid, which must not
+    have exec'd yet. A hardware event that cannot be opened falls
+    back to its software equivalent, if any.
+*/
+void openCounters(const PerfEventSet * set, pid_t pid, PerfCounters * counters) {
+    counters->number=set->number;
+    for (int i=0;i<set->number;++i) {
+        const PerfEvent * event=&perfEvents[set->events[i]];
+        counters->fds[i]=openEvent(event,pid);
+        counters->fallback[i]=false;
+        if (counters->fds[i]==-1&&event->fallback!=-1) {
+            counters->fds[i]=openEvent(&perfEvents[event->fallback],pid);
+            counters->fallback[i]=counters->fds[i]!=-1;
+        }
+    }
+}
+
+/*
+    printCounters prints one row per event below the timeX row of a
+    process, scaling counts up when the PMU was multiplexed.
+*/
+void printCounters(const PerfEventSet * set, PerfCounters * counters) {
+    for (int i=0;i<counters->number;++i) {
+        const PerfEvent * event=&perfEvents[set->events[i]];
+        uint64_t values[3];
+        if (counters->fds[i]==-1||read(counters->fds[i],values,sizeof(values))!=sizeof(values)) {
+            printf("%-10s%-22s%s\n","",event->name,"<not supported>");
+            continue;
+        }
+        double count=(double)values[0];
+        if (values[2]!=0&&values[2]<values[1]) {
+            count*=(double)values[1]/values[2];
+        }
+        if (counters->fallback[i]) {
+            printf("%-10s%-22s%.0lf (%s)\n","",event->name,count,perfEvents[event->fallback].name);
+        } else {
+            printf("%-10s%-22s%.0lf\n","",event->name,count);
+        }
+    }
+    fflush(stdout);
+}
+
+void closeCounters(PerfCounters * counters) {
+    for (int i=0;i<counters->number;++i) {
+        if (counters->fds[i]!=-1) {
+            close(counters->fds[i]);
+        }
+    }
+    counters->number=0;
+}
@@ -0,0 +1,32 @@
+#ifndef PERFEVENT_H
+#define PERFEVENT_H
+#include "util.h"
+#include <sys/types.h>
+
+#define PERF_MAX_EVENTS 16
+
+/*
+    A PerfEventSet is the list given to "timeX -e", as indexes into
+    the table of known events in perfevent.c.
+*/
+typedef struct PerfEventSet {
+    int number;
+    int events[PERF_MAX_EVENTS];
+} PerfEventSet;
+
+/*
+    PerfCounters holds one counter fd per event of a set for one
+    process, -1 when the event could not be opened. fallback marks
+    a hardware event counted by its software substitute.
+*/
+typedef struct PerfCounters {
+    int number;
+    int fds[PERF_MAX_EVENTS];
+    bool fallback[PERF_MAX_EVENTS];
+} PerfCounters;
+
+bool parseEvents(const char * list, PerfEventSet * set);
+void openCounters(const PerfEventSet * set, pid_t pid, PerfCounters * counters);
+void printCounters(const PerfEventSet * set, PerfCounters * counters);
+void closeCounters(PerfCounters * counters);
+#endif //PERFEVENT_H
@@ -0,0 +1,374 @@
+#define _GNU_SOURCE
+#include "placement.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+#define LONG_BITS (8*sizeof(unsigned long))
+
+/*
+    The order in which @spread hands out CPUs, computed on first use;
+    spreadNumber is -1 until then.
+*/
+static int * spreadOrder=nullptr;
+static int spreadNumber=-1;
+
+void initPlacement(Placement * placement) {
+    memset(placement->cpus,0,sizeof(placement->cpus));
+    placement->hasCpus=false;
+    placement->node=-1;
+    placement->hasNice=false;
+    placement->nice=0;
+    placement->policy=-1;
+    placement->priority=0;
+}
+
+/*
+    parseCpuList sets the bits of cpus for a list such as "0-7,16,18-19",
+    the syntax of @cpu and of the cpulist files of sysfs. It returns
+    false if list is not one or names a CPU beyond PLACEMENT_CPUS.
+*/
+bool parseCpuList(const char * list, unsigned long * cpus) {
+    const char * i=list;
+    bool any=false;
+    while (*i!='\0'&&*i!='\n') {
+        char * end;
+        long first=strtol(i,&end,10);
+        if (end==i||first<0) {
+            return false;
+        }
+        long last=first;
+        if (*end=='-') {
+            i=end+1;
+            last=strtol(i,&end,10);
+            if (end==i||last<first) {
+                return false;
+            }
+        }
+        if (last>=PLACEMENT_CPUS) {
+            return false;
+        }
+        for (long cpu=first;cpu<=last;++cpu) {
+            cpus[cpu/LONG_BITS]|=1UL<<(cpu%LONG_BITS);
+        }
+        any=true;
+        i=end;
+        if (*i==',') {
+            ++i;
+        } else if (*i!='\0'&&*i!='\n') {
+            return false;
+        }
+    }
+    return any;
+}
+
+/*
+    readSysfs reads the small file path into buffer, terminated by
+    '\0'. It returns false if it could not.
+*/
+bool readSysfs(const char * path, char * buffer, size_t size) {
+    int fd=open(path,O_RDONLY|O_CLOEXEC);
+    if (fd==-1) {
+        return false;
+    }
+    ssize_t length=read(fd,buffer,size-1);
+    close(fd);
+    if (length<0) {
+        return false;
+    }
+    buffer[length]='\0';
+    return true;
+}
+
+/*
+    parseNumber reads an integer between min and max from text.
+*/
+bool parseNumber(const char * text, int min, int max, int * number) {
+    char * end;
+    errno=0;
+    long value=strtol(text,&end,10);
+    if (errno!=0||end==text||*end!='\0'||value<min||value>max) {
+        return false;
+    }
+    *number=(int)value;
+    return true;
+}
+
+/*
+    parsePolicy reads the value of @sched: other, batch or idle, or
+    fifo and rr with an optional ":priority", 1 when it is omitted.
+*/
+bool parsePolicy(const char * text, Placement * placement) {
+    const char * names[]={"other","batch","idle","fifo","rr"};
+    const int policies[]={SCHED_OTHER,SCHED_BATCH,SCHED_IDLE,SCHED_FIFO,SCHED_RR};
+    for (int i=0;i!=5;++i) {
+        size_t length=strlen(names[i]);
+        if (strncmp(text,names[i],length)!=0||(text[length]!='\0'&&text[length]!=':')) {
+            continue;
+        }
+        bool realtime=policies[i]==SCHED_FIFO||policies[i]==SCHED_RR;
+        placement->policy=policies[i];
+        placement->priority=realtime?1:0;
+        if (text[length]==':') {
+            return realtime&&parseNumber(text+length+1,sched_get_priority_min(policies[i]),
+                                         sched_get_priority_max(policies[i]),&placement->priority);
+        }
+        return true;
+    }
+    return false;
+}
+
+/*
+    parseModifier applies one modifier word, "@cpu=list", "@node=n",
+    "@nice=n", "@sched=policy" or "@spread", to placement or spread.
+    It prints the error and returns false if word is not one.
+*/
+bool parseModifier(const char * word, Placement * placement, bool * spread) {
+    if (strcmp(word,"@spread")==0) {
+        *spread=true;
+        return true;
+    }
+    const char * value=strchr(word,'=');
+    size_t length=value==nullptr?0:(size_t)(value-word);
+    bool valid;
+    if (length==4&&strncmp(word,"@cpu",4)==0) {
+        memset(placement->cpus,0,sizeof(placement->cpus));
+        valid=placement->hasCpus=parseCpuList(value+1,placement->cpus);
+    } else if (length==5&&strncmp(word,"@node",5)==0) {
+        valid=parseNumber(value+1,0,PLACEMENT_NODES-1,&placement->node);
+        char path[64];
+        snprintf(path,sizeof(path),"/sys/devices/system/node/node%d",placement->node);
+        if (valid&&access(path,F_OK)!=0) {
+            fprintf(stderr,"myshell: %s: no such NUMA node\n",word);
+            return false;
+        }
+    } else if (length==5&&strncmp(word,"@nice",5)==0) {
+        valid=placement->hasNice=parseNumber(value+1,-20,19,&placement->nice);
+    } else if (length==6&&strncmp(word,"@sched",6)==0) {
+        valid=parsePolicy(value+1,placement);
+    } else {
+        fprintf(stderr,"myshell: unknown modifier %s\n",word);
+        return false;
+    }
+    if (!valid) {
+        fprintf(stderr,"myshell: invalid value in %s\n",word);
+    }
+    return valid;
+}
+
+/*
+    processCommand removes the leading "@" words of command and keeps
+    what they ask for in command->placement, allocated from the arena
+    of line only when there is something to apply. A node without
+    @cpu also restricts the CPUs to those of the node, read from its
+    cpulist. It returns false if a modifier is wrong or no command
+    follows them.
+*/
+bool processCommand(Line * line, Command * command) {
+    int number=0;
+    while (number<command->argc&&command->argv[number][0]=='@') {
+        ++number;
+    }
+    if (number==0) {
+        return true;
+    }
+    if (number==command->argc) {
+        fprintf(stderr,"myshell: \"%s\" needs a command\n",command->argv[0]);
+        return false;
+    }
+    Placement placement;
+    initPlacement(&placement);
+    for (int i=0;i!=number;++i) {
+        if (!parseModifier(command->argv[i],&placement,&line->spread)) {
+            return false;
+        }
+    }
+    if (placement.node!=-1&&!placement.hasCpus) {
+        char path[64];
+        char list[PLACEMENT_LIST_SIZE];
+        snprintf(path,sizeof(path),"/sys/devices/system/node/node%d/cpulist",placement.node);
+        placement.hasCpus=readSysfs(path,list,sizeof(list))&&parseCpuList(list,placement.cpus);
+    }
+    if (placement.hasCpus||placement.node!=-1||placement.hasNice||placement.policy!=-1) {
+        command->placement=(Placement*)arenaAlloc(line->arena,sizeof(Placement));
+        *command->placement=placement;
+    }
+    command->argc-=number;
+    command->argv+=number;
+    return true;
+}
+
+/*
+    processModifiers strips the "@" modifiers from every command of
+    line, the pipeline and the branches of a fan-out alike. Each
+    applies to its own command except @spread, which applies to the
+    whole line. It returns false if one of them is wrong.
+*/
+bool processModifiers(Line * line) {
+    for (int i=-1;i<line->branchNumber;++i) {
+        Command * iterator=i==-1?line->head:line->branch[i];
+        for (;iterator!=nullptr;iterator=iterator->next) {
+            if (!processCommand(line,iterator)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+    SpreadCpu is a CPU with its sort keys: its rank among the SMT
+    siblings of its core, the first CPU of its last level cache and
+    the first CPU of its core.
+*/
+typedef struct SpreadCpu {
+    int cpu;
+    int thread;
+    int cache;
+    int core;
+} SpreadCpu;
+
+int compareSpread(const void * a, const void * b) {
+    const SpreadCpu * x=(const SpreadCpu*)a;
+    const SpreadCpu * y=(const SpreadCpu*)b;
+    if (x->thread!=y->thread) {
+        return x->thread-y->thread;
+    }
+    if (x->cache!=y->cache) {
+        return x->cache-y->cache;
+    }
+    if (x->core!=y->core) {
+        return x->core-y->core;
+    }
+    return x->cpu-y->cpu;
+}
+
+/*
+    lastCache returns the first CPU sharing the last level cache of
+    cpu, i.e. the cache of sysfs with the highest level that holds
+    data, or cpu itself if sysfs does not tell.
+*/
+int lastCache(int cpu) {
+    int result=cpu;
+    int highest=0;
+    for (int index=0;index!=16;++index) {
+        char path[128];
+        char buffer[PLACEMENT_LIST_SIZE];
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu%d/cache/index%d/type",cpu,index);
+        if (!readSysfs(path,buffer,sizeof(buffer))) {
+            break;
+        }
+        if (strncmp(buffer,"Instruction",11)==0) {
+            continue;
+        }
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu%d/cache/index%d/level",cpu,index);
+        int level=readSysfs(path,buffer,sizeof(buffer))?atoi(buffer):0;
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",cpu,index);
+        if (level>highest&&readSysfs(path,buffer,sizeof(buffer))) {
+            highest=level;
+            result=atoi(buffer);
+        }
+    }
+    return result;
+}
+
+/*
+    computeSpread orders the CPUs the shell may run on so that
+    consecutive ones are distinct cores under the same last level
+    cache: the first thread of every core comes first, grouped by
+    cache, and the SMT siblings, which would share the execution
+    units of a core, only after them.
+*/
+void computeSpread() {
+    cpu_set_t allowed;
+    spreadNumber=0;
+    if (sched_getaffinity(0,sizeof(allowed),&allowed)!=0) {
+        return;
+    }
+    SpreadCpu * cpus=(SpreadCpu*)malloc(sizeof(SpreadCpu)*CPU_COUNT(&allowed));
+    for (int cpu=0;cpu!=CPU_SETSIZE;++cpu) {
+        if (!CPU_ISSET(cpu,&allowed)) {
+            continue;
+        }
+        char path[128];
+        char buffer[PLACEMENT_LIST_SIZE];
+        unsigned long siblings[PLACEMENT_CPUS/LONG_BITS]={0};
+        snprintf(path,sizeof(path),"/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",cpu);
+        SpreadCpu * entry=&cpus[spreadNumber++];
+        entry->cpu=cpu;
+        entry->thread=0;
+        entry->core=cpu;
+        entry->cache=lastCache(cpu);
+        if (readSysfs(path,buffer,sizeof(buffer))&&parseCpuList(buffer,siblings)) {
+            entry->core=atoi(buffer);
+            for (int sibling=0;sibling<cpu;++sibling) {
+                entry->thread+=(siblings[sibling/LONG_BITS]>>(sibling%LONG_BITS))&1;
+            }
+        }
+    }
+    qsort(cpus,spreadNumber,sizeof(SpreadCpu),compareSpread);
+    spreadOrder=(int*)malloc(sizeof(int)*spreadNumber);
+    for (int i=0;i!=spreadNumber;++i) {
+        spreadOrder[i]=cpus[i].cpu;
+    }
+    free(cpus);
+}
+
+/*
+    spreadCpu pins placement to the CPU of stage index of a line run
+    with @spread, wrapping around when there are more stages than
+    CPUs. It returns false if the CPUs could not be found.
+*/
+bool spreadCpu(int index, Placement * placement) {
+    if (spreadNumber==-1) {
+        computeSpread();
+    }
+    if (spreadNumber==0) {
+        return false;
+    }
+    int cpu=spreadOrder[index%spreadNumber];
+    memset(placement->cpus,0,sizeof(placement->cpus));
+    placement->cpus[cpu/LONG_BITS]=1UL<<(cpu%LONG_BITS);
+    placement->hasCpus=true;
+    return true;
+}
+
+/*
+    applyPlacement runs in the child before its exec and only issues
+    system calls: sched_setaffinity for the CPUs, set_mempolicy with
+    MPOL_BIND for the node, sched_setscheduler for the policy and
+    setpriority for the nice value. All of them survive the exec. It
+    returns false, with errno set, if one fails.
+*/
+bool applyPlacement(const Placement * placement) {
+    if (placement->hasCpus&&sched_setaffinity(0,sizeof(placement->cpus),(const cpu_set_t*)placement->cpus)==-1) {
+        return false;
+    }
+    if (placement->node!=-1) {
+        unsigned long nodes[PLACEMENT_NODES/LONG_BITS]={0};
+        nodes[placement->node/LONG_BITS]=1UL<<(placement->node%LONG_BITS);
+        if (syscall(SYS_set_mempolicy,MPOL_BIND,nodes,PLACEMENT_NODES+1)==-1) {
+            return false;
+        }
+    }
+    if (placement->policy!=-1) {
+        struct sched_param param={.sched_priority=placement->priority};
+        if (sched_setscheduler(0,placement->policy,&param)==-1) {
+            return false;
+        }
+    }
+    if (placement->hasNice&&setpriority(PRIO_PROCESS,0,placement->nice)==-1) {
+        return false;
+    }
+    return true;
+}
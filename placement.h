@@ -0,0 +1,13 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+#include "util.h"
+
+#define PLACEMENT_NODES 64
+#define PLACEMENT_LIST_SIZE 4096
+
+void initPlacement(Placement * placement);
+bool parseCpuList(const char * list, unsigned long * cpus);
+bool processModifiers(Line * line);
+bool spreadCpu(int index, Placement * placement);
+bool applyPlacement(const Placement * placement);
+#endif //PLACEMENT_H
@@ -0,0 +1,153 @@
+#include "procscan.h"
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+    ScanWork is shared by the threads of one scan: each of them takes
+    the next PROC_SCAN_CHUNK pids with an atomic add on next, so a
+    thread slowed down by a large /proc entry does not hold the others.
+*/
+typedef struct ScanWork {
+    int procFd;
+    pid_t * pids;
+    size_t size;
+    size_t next;
+    ProcSample * samples;
+    bool * valid;
+    long pageSize;
+} ScanWork;
+
+/*
+    readProcFile reads /proc/<pid>/<file> into buffer relative to the
+    /proc fd, so no path is resolved from the root. It returns the
+    length read, or -1 if the process is gone.
+*/
+ssize_t readProcFile(int procFd, pid_t pid, const char * file, char * buffer, size_t size) {
+    char path[64];
+    snprintf(path,sizeof(path),"%d/%s",pid,file);
+    int fd=openat(procFd,path,O_RDONLY|O_CLOEXEC);
+    if (fd==-1) {
+        return -1;
+    }
+    ssize_t length=read(fd,buffer,size-1);
+    close(fd);
+    if (length<=0) {
+        return -1;
+    }
+    buffer[length]='\0';
+    return length;
+}
+
+/*
+    sampleProcess fills sample from the stat and statm files of pid.
+*/
+bool sampleProcess(ScanWork * work, pid_t pid, ProcSample * sample) {
+    ProcStat stat;
+    if (!readProcStatAt(work->procFd,pid,&stat)) {
+        return false;
+    }
+    memcpy(sample->name,stat.comm,sizeof(sample->name));
+    sample->pid=pid;
+    sample->ppid=stat.ppid;
+    sample->state=stat.state;
+    sample->threads=(int)stat.numThreads;
+    sample->cpuTicks=stat.utime+stat.stime;
+    sample->startTicks=stat.starttime;
+    sample->rss=0;
+    char buffer[256];
+    if (readProcFile(work->procFd,pid,"statm",buffer,sizeof(buffer))!=-1) {
+        char * rest=nullptr;
+        strtoull(buffer,&rest,10);
+        sample->rss=strtoull(rest,nullptr,10)*work->pageSize;
+    }
+    return true;
+}
+
+void * scanWorker(void * data) {
+    ScanWork * work=(ScanWork*)data;
+    while (true) {
+        size_t begin=__atomic_fetch_add(&work->next,PROC_SCAN_CHUNK,__ATOMIC_RELAXED);
+        if (begin>=work->size) {
+            return nullptr;
+        }
+        size_t end=begin+PROC_SCAN_CHUNK<work->size?begin+PROC_SCAN_CHUNK:work->size;
+        size_t i=begin;
+        for (i=begin;i!=end;++i) {
+            work->valid[i]=sampleProcess(work,work->pids[i],&work->samples[i]);
+        }
+    }
+}
+
+/*
+    sampleProcesses lists /proc once and then reads every process on
+    up to PROC_SCAN_THREADS threads (one for fewer than
+    PROC_SCAN_PARALLEL_MIN processes, where starting threads costs
+    more than it saves). Processes that exit meanwhile are dropped.
+    It returns the samples and stores their number into size.
+*/
+ProcSample * sampleProcesses(size_t * size) {
+    ScanWork work;
+    *size=0;
+    work.procFd=open("/proc",O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (work.procFd==-1) {
+        return nullptr;
+    }
+    DIR * proc=fdopendir(dup(work.procFd));
+    size_t capacity=1024;
+    work.pids=(pid_t*)malloc(sizeof(pid_t)*capacity);
+    work.size=0;
+    struct dirent * entry=nullptr;
+    while (proc!=nullptr&&(entry=readdir(proc))!=nullptr) {
+        if (entry->d_name[0]<'0'||entry->d_name[0]>'9') {
+            continue;
+        }
+        if (work.size==capacity) {
+            capacity*=2;
+            work.pids=(pid_t*)realloc(work.pids,sizeof(pid_t)*capacity);
+        }
+        work.pids[work.size++]=atoi(entry->d_name);
+    }
+    if (proc!=nullptr) {
+        closedir(proc);
+    }
+    work.next=0;
+    work.samples=(ProcSample*)malloc(sizeof(ProcSample)*(work.size+1));
+    work.valid=(bool*)calloc(work.size+1,sizeof(bool));
+    work.pageSize=sysconf(_SC_PAGESIZE);
+
+    long threadNumber=sysconf(_SC_NPROCESSORS_ONLN);
+    threadNumber=threadNumber<PROC_SCAN_THREADS?threadNumber:PROC_SCAN_THREADS;
+    if (work.size<PROC_SCAN_PARALLEL_MIN||threadNumber<2) {
+        threadNumber=1;
+    }
+    pthread_t threads[PROC_SCAN_THREADS];
+    long started=0;
+    for (started=0;started<threadNumber-1;++started) {
+        if (pthread_create(&threads[started],nullptr,scanWorker,&work)!=0) {
+            break;
+        }
+    }
+    scanWorker(&work);
+    long i=0;
+    for (i=0;i<started;++i) {
+        pthread_join(threads[i],nullptr);
+    }
+
+    size_t kept=0;
+    size_t j=0;
+    for (j=0;j!=work.size;++j) {
+        if (work.valid[j]) {
+            work.samples[kept++]=work.samples[j];
+        }
+    }
+    free(work.valid);
+    free(work.pids);
+    close(work.procFd);
+    *size=kept;
+    return work.samples;
+}
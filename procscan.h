@@ -0,0 +1,28 @@
+#ifndef PROCSCAN_H
+#define PROCSCAN_H
+#include "util.h"
+#include "procstat.h"
+#include <sys/types.h>
+
+#define PROC_SCAN_THREADS 8
+#define PROC_SCAN_PARALLEL_MIN 1024
+#define PROC_SCAN_CHUNK 128
+
+/*
+    ProcSample is what "viewtree -a" shows of one process, read from
+    /proc/<pid>/stat and /proc/<pid>/statm. cpuTicks is utime + stime
+    and startTicks the start time since boot, both in clock ticks.
+*/
+typedef struct ProcSample {
+    pid_t pid;
+    pid_t ppid;
+    char state;
+    int threads;
+    unsigned long long rss;
+    unsigned long long cpuTicks;
+    unsigned long long startTicks;
+    char name[PROC_COMM_SIZE];
+} ProcSample;
+
+ProcSample * sampleProcesses(size_t * size);
+#endif //PROCSCAN_H
@@ -0,0 +1,123 @@
+#include "procstat.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+    parseProcStat fills stat from the contents of a stat file. The
+    comm field ends at the last ')' of the buffer, because the name
+    itself may contain spaces and parentheses. The numbers after it
+    are read in one pass into values. Nothing is allocated.
+*/
+bool parseProcStat(const char * buffer, size_t length, ProcStat * stat) {
+    const char * end=buffer+length;
+    const char * open=memchr(buffer,'(',length);
+    const char * close=end;
+    while (close!=buffer&&*(close-1)!=')') {
+        --close;
+    }
+    if (open==nullptr||close==buffer||close<=open+1||end-close<3) {
+        return false;
+    }
+    --close;
+    // fields 4 to 52 of proc(5), the ones a kernel does not print stay 0.
+    unsigned long long values[PROC_STAT_FIELDS]={0};
+    const char * cursor=close+4<end?close+4:end;
+    int count=0;
+    while (cursor<end&&count!=PROC_STAT_FIELDS) {
+        bool negative=*cursor=='-';
+        cursor+=negative;
+        unsigned long long value=0;
+        while (cursor<end&&(unsigned)(*cursor-'0')<10) {
+            value=value*10+(*cursor-'0');
+            ++cursor;
+        }
+        values[count++]=negative?-value:value;
+        ++cursor;
+    }
+    stat->pid=0;
+    for (cursor=buffer;cursor<open&&(unsigned)(*cursor-'0')<10;++cursor) {
+        stat->pid=stat->pid*10+(*cursor-'0');
+    }
+    size_t size=close-open-1;
+    size=size<PROC_COMM_SIZE-1?size:PROC_COMM_SIZE-1;
+    memcpy(stat->comm,open+1,size);
+    stat->comm[size]='\0';
+    stat->state=close[2];
+    stat->ppid=(pid_t)values[0];
+    stat->pgrp=(pid_t)values[1];
+    stat->session=(pid_t)values[2];
+    stat->ttyNr=(int)values[3];
+    stat->tpgid=(pid_t)values[4];
+    stat->flags=(unsigned)values[5];
+    stat->minflt=values[6];
+    stat->cminflt=values[7];
+    stat->majflt=values[8];
+    stat->cmajflt=values[9];
+    stat->utime=values[10];
+    stat->stime=values[11];
+    stat->cutime=(long)values[12];
+    stat->cstime=(long)values[13];
+    stat->priority=(long)values[14];
+    stat->nice=(long)values[15];
+    stat->numThreads=(long)values[16];
+    stat->itrealvalue=(long)values[17];
+    stat->starttime=values[18];
+    stat->vsize=values[19];
+    stat->rss=(long)values[20];
+    stat->rsslim=values[21];
+    stat->startcode=values[22];
+    stat->endcode=values[23];
+    stat->startstack=values[24];
+    stat->kstkesp=values[25];
+    stat->kstkeip=values[26];
+    stat->signal=values[27];
+    stat->blocked=values[28];
+    stat->sigignore=values[29];
+    stat->sigcatch=values[30];
+    stat->wchan=values[31];
+    stat->nswap=values[32];
+    stat->cnswap=values[33];
+    stat->exitSignal=(int)values[34];
+    stat->processor=(int)values[35];
+    stat->rtPriority=(unsigned)values[36];
+    stat->policy=(unsigned)values[37];
+    stat->delayacctBlkioTicks=values[38];
+    stat->guestTime=values[39];
+    stat->cguestTime=(long)values[40];
+    stat->startData=values[41];
+    stat->endData=values[42];
+    stat->startBrk=values[43];
+    stat->argStart=values[44];
+    stat->argEnd=values[45];
+    stat->envStart=values[46];
+    stat->envEnd=values[47];
+    stat->exitCode=(int)values[48];
+    return true;
+}
+
+/*
+    readProcStatAt reads <pid>/stat relative to dirFd (a /proc fd, or
+    AT_FDCWD for an absolute path) with a single pread() into a stack
+    buffer and parses it. It returns false if the process is gone.
+*/
+bool readProcStatAt(int dirFd, pid_t pid, ProcStat * stat) {
+    char path[32];
+    char buffer[PROC_STAT_BUFFER];
+    snprintf(path,sizeof(path),dirFd==AT_FDCWD?"/proc/%d/stat":"%d/stat",pid);
+    int fd=openat(dirFd,path,O_RDONLY|O_CLOEXEC);
+    if (fd==-1) {
+        return false;
+    }
+    ssize_t length=pread(fd,buffer,sizeof(buffer),0);
+    close(fd);
+    if (length<=0) {
+        return false;
+    }
+    return parseProcStat(buffer,(size_t)length,stat);
+}
+
+bool readProcStat(pid_t pid, ProcStat * stat) {
+    return readProcStatAt(AT_FDCWD,pid,stat);
+}
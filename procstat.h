@@ -0,0 +1,73 @@
+#ifndef PROCSTAT_H
+#define PROCSTAT_H
+#include "util.h"
+#include <sys/types.h>
+
+#define PROC_STAT_BUFFER 1024
+#define PROC_COMM_SIZE 64
+#define PROC_STAT_FIELDS 49
+
+/*
+    ProcStat holds every field of /proc/<pid>/stat in the order of
+    proc(5). Fields that an older kernel does not print are left 0.
+    Times are in clock ticks, rss in pages.
+*/
+typedef struct ProcStat {
+    pid_t pid;
+    char comm[PROC_COMM_SIZE];
+    char state;
+    pid_t ppid;
+    pid_t pgrp;
+    pid_t session;
+    int ttyNr;
+    pid_t tpgid;
+    unsigned flags;
+    unsigned long minflt;
+    unsigned long cminflt;
+    unsigned long majflt;
+    unsigned long cmajflt;
+    unsigned long utime;
+    unsigned long stime;
+    long cutime;
+    long cstime;
+    long priority;
+    long nice;
+    long numThreads;
+    long itrealvalue;
+    unsigned long long starttime;
+    unsigned long vsize;
+    long rss;
+    unsigned long rsslim;
+    unsigned long startcode;
+    unsigned long endcode;
+    unsigned long startstack;
+    unsigned long kstkesp;
+    unsigned long kstkeip;
+    unsigned long signal;
+    unsigned long blocked;
+    unsigned long sigignore;
+    unsigned long sigcatch;
+    unsigned long wchan;
+    unsigned long nswap;
+    unsigned long cnswap;
+    int exitSignal;
+    int processor;
+    unsigned rtPriority;
+    unsigned policy;
+    unsigned long long delayacctBlkioTicks;
+    unsigned long guestTime;
+    long cguestTime;
+    unsigned long startData;
+    unsigned long endData;
+    unsigned long startBrk;
+    unsigned long argStart;
+    unsigned long argEnd;
+    unsigned long envStart;
+    unsigned long envEnd;
+    int exitCode;
+} ProcStat;
+
+bool parseProcStat(const char * buffer, size_t length, ProcStat * stat);
+bool readProcStatAt(int dirFd, pid_t pid, ProcStat * stat);
+bool readProcStat(pid_t pid, ProcStat * stat);
+#endif //PROCSTAT_H
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include "redirect.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+    writeAll writes size bytes of data to fd.
+*/
+bool writeAll(int fd, const char * data, size_t size) {
+    while (size!=0) {
+        ssize_t written=write(fd,data,size);
+        if (written==-1&&errno==EINTR) {
+            continue;
+        }
+        if (written<=0) {
+            return false;
+        }
+        data+=written;
+        size-=written;
+    }
+    return true;
+}
+
+/*
+    hereString returns a memfd holding word and a newline, positioned
+    at its start, so that no temporary file or writer process is
+    needed.
+*/
+int hereString(const char * word) {
+    int fd=memfd_create("here-string",MFD_CLOEXEC);
+    if (fd==-1) {
+        return -1;
+    }
+    if (!writeAll(fd,word,strlen(word))||!writeAll(fd,"\n",1)||lseek(fd,0,SEEK_SET)==-1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+    openRedirects opens the files, here-strings and here-docs of cmd
+    with O_CLOEXEC above the redirectable fds and fills set with the
+    pairs for spawnCommand.
+    Here-docs are rewound so that they can be read again. It prints
+    an error, closes what it opened and returns false if one of them
+    cannot be opened.
+*/
+bool openRedirects(Command * cmd, RedirectSet * set) {
+    set->number=0;
+    set->openedNumber=0;
+    Redirect * redirect=cmd->redirects;
+    for (;redirect!=nullptr;redirect=redirect->next) {
+        int fd=-1;
+        if (redirect->type==REDIRECT_DUP) {
+            fd=redirect->source;
+        } else if (redirect->type==REDIRECT_HERE_STRING) {
+            fd=moveHigh(hereString(redirect->word));
+        } else if (redirect->type==REDIRECT_HERE_DOC) {
+            if (redirect->memfd==-1) {
+                redirect->memfd=memfd_create("here-doc",MFD_CLOEXEC);
+            }
+            fd=redirect->memfd==-1?-1:fcntl(redirect->memfd,F_DUPFD_CLOEXEC,REDIRECT_FD_BASE);
+            if (fd!=-1) {
+                lseek(fd,0,SEEK_SET);
+            }
+        } else {
+            int flags=O_RDONLY;
+            if (redirect->type==REDIRECT_OUTPUT) {
+                flags=O_WRONLY|O_CREAT|O_TRUNC;
+            } else if (redirect->type==REDIRECT_APPEND) {
+                flags=O_WRONLY|O_CREAT|O_APPEND;
+            }
+            fd=moveHigh(open(redirect->word,flags|O_CLOEXEC,0666));
+        }
+        if (fd==-1) {
+            fprintf(stderr,"myshell: %s: %s\n",redirect->word,strerror(errno));
+            closeRedirects(set);
+            return false;
+        }
+        if (redirect->type!=REDIRECT_DUP) {
+            set->opened[set->openedNumber++]=fd;
+        }
+        set->pairs[set->number++]=(SpawnRedirect){fd,redirect->fd};
+    }
+    return true;
+}
+
+void closeRedirects(RedirectSet * set) {
+    int i=0;
+    for (i=0;i!=set->openedNumber;++i) {
+        close(set->opened[i]);
+    }
+    set->openedNumber=0;
+}
+
+/*
+    redirectShell applies the redirections of a built-in that runs in
+    the shell itself, saving every fd it replaces. restoreShell puts
+    them back in reverse order. Both flush stdout first so that what
+    printf buffered goes where it was meant to.
+*/
+bool redirectShell(Command * cmd, RedirectSet * set) {
+    if (!openRedirects(cmd,set)) {
+        return false;
+    }
+    fflush(stdout);
+    int i=0;
+    for (i=0;i!=set->number;++i) {
+        SpawnRedirect * pair=&set->pairs[i];
+        set->saved[i]=fcntl(pair->to,F_DUPFD_CLOEXEC,REDIRECT_FD_BASE);
+        if (pair->from!=pair->to&&dup2(pair->from,pair->to)==-1) {
+            fprintf(stderr,"myshell: %d: %s\n",pair->from,strerror(errno));
+            set->number=i+1;
+            restoreShell(set);
+            return false;
+        }
+    }
+    return true;
+}
+
+void restoreShell(RedirectSet * set) {
+    fflush(stdout);
+    int i=set->number;
+    while (i--!=0) {
+        SpawnRedirect * pair=&set->pairs[i];
+        if (set->saved[i]!=-1) {
+            dup2(set->saved[i],pair->to);
+            close(set->saved[i]);
+        } else if (pair->from!=pair->to) {
+            close(pair->to);
+        }
+    }
+    set->number=0;
+    closeRedirects(set);
+}
+
+/*
+    returns true while a here-doc of line still waits for lines.
+*/
+bool hereDocPending(Line * line) {
+    Redirect * hereDoc=line->hereDocs;
+    for (;hereDoc!=nullptr;hereDoc=hereDoc->nextHereDoc) {
+        if (!hereDoc->complete) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    feedHereDoc gives the next input line to the first incomplete
+    here-doc of line: the delimiter completes it, any other line is
+    appended to its memfd.
+*/
+void feedHereDoc(Line * line, const char * text) {
+    Redirect * hereDoc=line->hereDocs;
+    while (hereDoc!=nullptr&&hereDoc->complete) {
+        hereDoc=hereDoc->nextHereDoc;
+    }
+    if (hereDoc==nullptr) {
+        return;
+    }
+    if (strcmp(text,hereDoc->word)==0) {
+        hereDoc->complete=true;
+        return;
+    }
+    if (hereDoc->memfd==-1) {
+        hereDoc->memfd=memfd_create("here-doc",MFD_CLOEXEC);
+    }
+    if (hereDoc->memfd!=-1) {
+        writeAll(hereDoc->memfd,text,strlen(text));
+        writeAll(hereDoc->memfd,"\n",1);
+    }
+}
+
+/*
+    closeHereDocs closes the memfds of the here-docs of line; it is
+    called by freeLine().
+*/
+void closeHereDocs(Line * line) {
+    Redirect * hereDoc=line->hereDocs;
+    for (;hereDoc!=nullptr;hereDoc=hereDoc->nextHereDoc) {
+        if (hereDoc->memfd!=-1) {
+            close(hereDoc->memfd);
+            hereDoc->memfd=-1;
+        }
+    }
+}
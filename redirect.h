@@ -0,0 +1,27 @@
+#ifndef REDIRECT_H
+#define REDIRECT_H
+#include "util.h"
+#include "spawn.h"
+
+/*
+    RedirectSet holds the redirections of one command once the shell
+    has opened them: pairs is what the child applies, opened are the
+    fds the shell must close after the spawn and saved the copies of
+    the shell's own fds while a built-in runs redirected.
+*/
+typedef struct RedirectSet {
+    SpawnRedirect pairs[REDIRECT_MAX];
+    int number;
+    int opened[REDIRECT_MAX];
+    int openedNumber;
+    int saved[REDIRECT_MAX];
+} RedirectSet;
+
+bool openRedirects(Command * cmd, RedirectSet * set);
+void closeRedirects(RedirectSet * set);
+bool redirectShell(Command * cmd, RedirectSet * set);
+void restoreShell(RedirectSet * set);
+bool hereDocPending(Line * line);
+void feedHereDoc(Line * line, const char * text);
+void closeHereDocs(Line * line);
+#endif //REDIRECT_H
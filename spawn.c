@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include "spawn.h"
+#include "util.h"
+#include "builtin.h"
+#include "placement.h"
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+/*
+    The child shares our address space (CLONE_VM) and we are
+    suspended until it execs or exits (CLONE_VFORK), so a single
+    static stack is enough for it and no copy of the shell's
+    page tables is ever made.
+*/
+static char spawnStack[SPAWN_STACK_SIZE] __attribute__((aligned(16)));
+
+typedef struct SpawnArgs {
+    char ** argv;
+    SpawnAttr * attr;
+} SpawnArgs;
+
+void initSpawnAttr(SpawnAttr * attr) {
+    attr->path=nullptr;
+    attr->stdinFd=-1;
+    attr->stdoutFd=-1;
+    attr->pgid=SPAWN_NO_PGID;
+    attr->terminalFd=-1;
+    attr->holdFd=-1;
+    attr->redirects=nullptr;
+    attr->redirectNumber=0;
+    attr->limits=nullptr;
+    attr->limitNumber=0;
+    attr->cgroupFd=-1;
+    attr->placement=nullptr;
+    attr->builtin=nullptr;
+    attr->error=0;
+}
+
+/*
+    failChild ends the child after a failed step with status 127. A
+    child sharing our memory leaves error in attr for spawnCommand to
+    report, a copy of the shell has to report it itself.
+*/
+void failChild(SpawnArgs * args, int error) {
+    SpawnAttr * attr=args->attr;
+    attr->error=error;
+    if (attr->holdFd!=-1||attr->builtin!=nullptr) {
+        dprintf(STDERR_FILENO,"myshell: '%s': %s\n",args->argv[0],strerror(error));
+    }
+    _exit(127);
+}
+
+/*
+    execScript runs path, an executable without a "#!" line, with
+    /bin/sh as execvp() does on ENOEXEC. The new argv lives on the
+    stack of the child, as malloc can not be used there. It only
+    returns if the exec failed, with errno set.
+*/
+void execScript(const char * path, char ** argv) {
+    int argc=0;
+    while (argv[argc]!=nullptr) {
+        ++argc;
+    }
+    char * shell[argc+2];
+    shell[0]="/bin/sh";
+    shell[1]=(char*)path;
+    for (int i=1;i<=argc;++i) {
+        shell[i+1]=argv[i];
+    }
+    execv(shell[0],shell);
+}
+
+/*
+    spawnChild runs in the child on spawnStack. It only issues
+    system calls: it resets every caught signal, and the job
+    control signals the shell ignores, to their default action so
+    that no shell handler can run on the shared memory. It joins
+    the process group and takes the terminal for it while signals
+    are still blocked, then unblocks every signal (the shell keeps
+    SIGCHLD blocked), moves the pipe ends onto stdin/stdout, applies
+    the redirections, sets its limits, moves itself into the cgroup
+    of its job, applies its placement and execs, through /bin/sh for
+    a script without "#!" like execvp() would, or runs the built-in
+    and exits. The pipe fds themselves are created with O_CLOEXEC so
+    they vanish on exec.
+*/
+int spawnChild(void * data) {
+    SpawnArgs * args=(SpawnArgs*)data;
+    SpawnAttr * attr=args->attr;
+    int sig=1;
+    for (sig=1;sig<_NSIG;++sig) {
+        struct sigaction act;
+        if (sigaction(sig,nullptr,&act)!=0||act.sa_handler==SIG_DFL) {
+            continue;
+        }
+        if (act.sa_handler!=SIG_IGN||sig==SIGTSTP||sig==SIGTTIN||sig==SIGTTOU) {
+            act.sa_handler=SIG_DFL;
+            act.sa_flags=0;
+            sigaction(sig,&act,nullptr);
+        }
+    }
+    if (attr->pgid!=SPAWN_NO_PGID&&setpgid(0,attr->pgid)==-1) {
+        failChild(args,errno);
+    }
+    if (attr->terminalFd!=-1) {
+        tcsetpgrp(attr->terminalFd,getpgrp());
+    }
+    sigset_t empty;
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK,&empty,nullptr);
+    if (attr->stdinFd!=-1&&dup2(attr->stdinFd,STDIN_FILENO)==-1) {
+        failChild(args,errno);
+    }
+    if (attr->stdoutFd!=-1&&dup2(attr->stdoutFd,STDOUT_FILENO)==-1) {
+        failChild(args,errno);
+    }
+    int i=0;
+    for (i=0;i!=attr->redirectNumber;++i) {
+        const SpawnRedirect * redirect=&attr->redirects[i];
+        // an fd opened by the shell on its own number only loses O_CLOEXEC.
+        int result=redirect->from==redirect->to?fcntl(redirect->to,F_SETFD,0):dup2(redirect->from,redirect->to);
+        if (result==-1) {
+            failChild(args,errno);
+        }
+    }
+    for (i=0;i!=attr->limitNumber;++i) {
+        if (setrlimit(attr->limits[i].resource,&attr->limits[i].value)==-1) {
+            failChild(args,errno);
+        }
+    }
+    if (attr->cgroupFd!=-1&&write(attr->cgroupFd,"0",1)==-1) {
+        failChild(args,errno);
+    }
+    if (attr->placement!=nullptr&&!applyPlacement(attr->placement)) {
+        failChild(args,errno);
+    }
+    if (attr->holdFd!=-1) {
+        char go;
+        while (read(attr->holdFd,&go,1)==-1&&errno==EINTR) {
+        }
+    }
+    if (attr->builtin!=nullptr) {
+        int argc=0;
+        while (args->argv[argc]!=nullptr) {
+            ++argc;
+        }
+        _exit(runBuiltin(attr->builtin,argc,args->argv));
+    }
+    if (attr->path!=nullptr) {
+        execv(attr->path,args->argv);
+        if (errno==ENOEXEC) {
+            execScript(attr->path,args->argv);
+        }
+    } else {
+        execvp(args->argv[0],args->argv);
+    }
+    failChild(args,errno);
+    return 127;
+}
+
+/*
+    spawnCommand starts argv[0] with clone(CLONE_VM | CLONE_VFORK).
+    All signals are blocked around the clone so that no handler runs
+    in the child before it has reset them. When it returns the child
+    has either exec'd or failed; in the latter case the error is
+    reported here and attr->error is set. A held child or one that
+    runs a built-in is a copy of the shell instead, so stdout is
+    flushed first lest it prints what we buffered. It returns the pid
+    of the child, or -1 if it could not be created.
+*/
+pid_t spawnCommand(char ** argv, SpawnAttr * attr) {
+    sigset_t all;
+    sigset_t oldmask;
+    sigfillset(&all);
+    bool copied=attr->holdFd!=-1||attr->builtin!=nullptr;
+    if (copied) {
+        fflush(stdout);
+    }
+    sigprocmask(SIG_BLOCK,&all,&oldmask);
+    attr->error=0;
+    SpawnArgs args={argv,attr};
+    int savedErrno=errno;
+    int flags=copied?SIGCHLD:CLONE_VM|CLONE_VFORK|SIGCHLD;
+    pid_t pid=clone(spawnChild,spawnStack+SPAWN_STACK_SIZE,flags,&args);
+    int cloneErrno=errno;
+    errno=savedErrno;
+    sigprocmask(SIG_SETMASK,&oldmask,nullptr);
+    if (pid==-1) {
+        fprintf(stderr,"myshell: can not spawn '%s': %s\n",argv[0],strerror(cloneErrno));
+        return -1;
+    }
+    if (attr->error!=0) {
+        fprintf(stderr,"myshell: '%s': %s\n",argv[0],strerror(attr->error));
+    }
+    if (copied&&attr->pgid!=SPAWN_NO_PGID) {
+        setpgid(pid,attr->pgid==0?pid:attr->pgid);
+    }
+    return pid;
+}
@@ -0,0 +1,64 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define SPAWN_NO_PGID -1
+#define SPAWN_STACK_SIZE (256 * 1024)
+
+/*
+    path is exec'd directly when it is not nullptr, else argv[0] is
+    searched in PATH. stdinFd/stdoutFd are duplicated onto 0/1 in the
+    child when they are not -1. pgid is passed to setpgid() in the
+    child unless it is SPAWN_NO_PGID. When terminalFd is not -1 the
+    child makes its process group the foreground group of that
+    terminal. error is written by the child when exec fails.
+
+    When holdFd is not -1 the child gets a copy of our memory instead
+    of sharing it and waits for a byte on holdFd before it execs, so
+    that the caller can attach to it first (timeX -e). Such a child
+    reports its errors itself.
+
+    The redirectNumber entries of redirects are applied in order after
+    stdin and stdout: each duplicates its from fd onto its to fd.
+
+    The limitNumber entries of limits are set with setrlimit() in the
+    child, and when cgroupFd is not -1, the cgroup.procs file of a
+    cgroup, the child moves itself there before its exec. Then it
+    applies placement, its CPUs, memory node, policy and nice value,
+    unless it is nullptr.
+
+    When builtin is not nullptr the child runs it instead of an exec.
+    Like a held child it gets a copy of our memory, as the built-in
+    may use stdio and malloc.
+*/
+typedef struct SpawnRedirect {
+    int from;
+    int to;
+} SpawnRedirect;
+
+typedef struct SpawnLimit {
+    int resource;
+    struct rlimit value;
+} SpawnLimit;
+
+typedef struct SpawnAttr {
+    const char * path;
+    int stdinFd;
+    int stdoutFd;
+    pid_t pgid;
+    int terminalFd;
+    int holdFd;
+    const SpawnRedirect * redirects;
+    int redirectNumber;
+    const SpawnLimit * limits;
+    int limitNumber;
+    int cgroupFd;
+    const struct Placement * placement;
+    const struct Builtin * builtin;
+    int error;
+} SpawnAttr;
+
+void initSpawnAttr(SpawnAttr * attr);
+pid_t spawnCommand(char ** argv, SpawnAttr * attr);
+#endif //SPAWN_H
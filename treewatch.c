@@ -0,0 +1,588 @@
+#include "treewatch.h"
+#include "viewtree.h"
+#include "util.h"
+#include "input.h"
+#include "procstat.h"
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+extern volatile sig_atomic_t sigint_flag;
+
+#define WATCH_BUCKETS 1024
+#define WATCH_EVENT_BUFFER 16384
+#define WATCH_PROBE_MS 200
+
+/*
+    WatchEntry chains a PIDNode into the pid index of a Watch.
+    generation is the last /proc listing the process was seen in;
+    state and started are its state and start time at that listing,
+    0 until a listing has read them.
+*/
+typedef struct WatchEntry {
+    PIDNode * node;
+    unsigned long generation;
+    char state;
+    unsigned long long started;
+    struct WatchEntry * next;
+} WatchEntry;
+
+/*
+    A Watch keeps a PIDNode for every process of the system between
+    refreshes, linked into one forest through child/next, so that a
+    change only touches the nodes involved. connector is the netlink
+    proc connector socket, or -1 when /proc listings are diffed
+    instead. lines holds the previous frame, one string per row.
+*/
+typedef struct Watch {
+    WatchEntry ** buckets;
+    size_t bucketNumber;
+    size_t size;
+    unsigned long generation;
+    int connector;
+    bool changed;
+    TextBuffer frame;
+    char ** lines;
+    size_t lineNumber;
+} Watch;
+
+WatchEntry * findWatchEntry(Watch * watch, pid_t pid) {
+    WatchEntry * entry=watch->buckets[pid%watch->bucketNumber];
+    while (entry!=nullptr&&entry->node->PID!=pid) {
+        entry=entry->next;
+    }
+    return entry;
+}
+
+PIDNode * findWatchNode(Watch * watch, pid_t pid) {
+    WatchEntry * entry=findWatchEntry(watch,pid);
+    return entry!=nullptr?entry->node:nullptr;
+}
+
+WatchEntry * insertWatchEntry(Watch * watch, PIDNode * node) {
+    if (watch->size>=watch->bucketNumber*2) {
+        size_t number=watch->bucketNumber*2;
+        WatchEntry ** buckets=(WatchEntry**)calloc(number,sizeof(WatchEntry*));
+        size_t i=0;
+        for (i=0;i!=watch->bucketNumber;++i) {
+            WatchEntry * entry=watch->buckets[i];
+            while (entry!=nullptr) {
+                WatchEntry * next=entry->next;
+                entry->next=buckets[entry->node->PID%number];
+                buckets[entry->node->PID%number]=entry;
+                entry=next;
+            }
+        }
+        free(watch->buckets);
+        watch->buckets=buckets;
+        watch->bucketNumber=number;
+    }
+    WatchEntry * entry=(WatchEntry*)malloc(sizeof(WatchEntry));
+    entry->node=node;
+    entry->generation=watch->generation;
+    entry->state=0;
+    entry->started=0;
+    entry->next=watch->buckets[node->PID%watch->bucketNumber];
+    watch->buckets[node->PID%watch->bucketNumber]=entry;
+    ++watch->size;
+    return entry;
+}
+
+void removeWatchEntry(Watch * watch, pid_t pid) {
+    WatchEntry ** iterator=&watch->buckets[pid%watch->bucketNumber];
+    while (*iterator!=nullptr&&(*iterator)->node->PID!=pid) {
+        iterator=&(*iterator)->next;
+    }
+    if (*iterator!=nullptr) {
+        WatchEntry * entry=*iterator;
+        *iterator=entry->next;
+        free(entry);
+        --watch->size;
+    }
+}
+
+/*
+    attach links node into the children of its parent, keeping them
+    in ascending PID order. It costs O(siblings).
+*/
+void attach(Watch * watch, PIDNode * node) {
+    PIDNode * parent=findWatchNode(watch,node->PPID);
+    if (parent==nullptr||parent==node) {
+        return;
+    }
+    PIDNode ** iterator=&parent->child;
+    while (*iterator!=nullptr&&(*iterator)->PID<node->PID) {
+        iterator=&(*iterator)->next;
+    }
+    node->next=*iterator;
+    *iterator=node;
+}
+
+void detach(Watch * watch, PIDNode * node) {
+    PIDNode * parent=findWatchNode(watch,node->PPID);
+    if (parent==nullptr) {
+        return;
+    }
+    PIDNode ** iterator=&parent->child;
+    while (*iterator!=nullptr&&*iterator!=node) {
+        iterator=&(*iterator)->next;
+    }
+    if (*iterator!=nullptr) {
+        *iterator=node->next;
+    }
+    node->next=nullptr;
+}
+
+void addProcess(Watch * watch, PIDNode * node) {
+    if (findWatchNode(watch,node->PID)!=nullptr) {
+        free(node->name);
+        free(node);
+        return;
+    }
+    insertWatchEntry(watch,node);
+    attach(watch,node);
+    watch->changed=true;
+}
+
+/*
+    forkProcess adds child of parent without reading /proc: until it
+    execs, a child has the name of its parent.
+*/
+void forkProcess(Watch * watch, pid_t parentPid, pid_t pid) {
+    PIDNode * parent=findWatchNode(watch,parentPid);
+    PIDNode * node=nullptr;
+    if (parent==nullptr) {
+        node=buildPIDNode(pid);
+    } else {
+        node=(PIDNode*)malloc(sizeof(PIDNode));
+        node->PID=pid;
+        node->PPID=parentPid;
+        node->name=strdup(parent->name);
+        node->child=nullptr;
+        node->next=nullptr;
+    }
+    if (node!=nullptr) {
+        addProcess(watch,node);
+    }
+}
+
+/*
+    renameProcess sets the name of pid to name, or to the one in
+    /proc/pid/stat if name is nullptr (after an exec).
+*/
+void renameProcess(Watch * watch, pid_t pid, const char * name) {
+    PIDNode * node=findWatchNode(watch,pid);
+    if (node==nullptr) {
+        return;
+    }
+    PIDNode * fresh=nullptr;
+    if (name==nullptr) {
+        fresh=buildPIDNode(pid);
+        if (fresh==nullptr) {
+            return;
+        }
+        name=fresh->name;
+    }
+    if (strcmp(node->name,name)!=0) {
+        free(node->name);
+        node->name=strdup(name);
+        watch->changed=true;
+    }
+    if (fresh!=nullptr) {
+        free(fresh->name);
+        free(fresh);
+    }
+}
+
+/*
+    removeProcess drops pid. Its children have been reparented by the
+    kernel, so only their /proc entries are read again to find their
+    new parents.
+*/
+void removeProcess(Watch * watch, pid_t pid) {
+    PIDNode * node=findWatchNode(watch,pid);
+    if (node==nullptr) {
+        return;
+    }
+    detach(watch,node);
+    PIDNode * orphan=node->child;
+    node->child=nullptr;
+    removeWatchEntry(watch,pid);
+    while (orphan!=nullptr) {
+        PIDNode * next=orphan->next;
+        PIDNode * fresh=buildPIDNode(orphan->PID);
+        orphan->next=nullptr;
+        orphan->PPID=fresh!=nullptr?fresh->PPID:0;
+        if (fresh!=nullptr) {
+            free(fresh->name);
+            free(fresh);
+        }
+        attach(watch,orphan);
+        orphan=next;
+    }
+    free(node->name);
+    free(node);
+    watch->changed=true;
+}
+
+/*
+    updateProcess compares a known process with stat, just read from
+    /proc: a new name, e.g. after an exec, is taken, a new parent
+    reattaches it and a new state marks the watch changed. It returns
+    false if stat has another start time, i.e. the pid was reused by
+    another process, which the caller then adds afresh.
+*/
+bool updateProcess(Watch * watch, WatchEntry * known, const ProcStat * stat) {
+    if (known->started!=0&&known->started!=stat->starttime) {
+        return false;
+    }
+    PIDNode * node=known->node;
+    renameProcess(watch,node->PID,stat->comm);
+    if (node->PPID!=stat->ppid) {
+        detach(watch,node);
+        node->PPID=stat->ppid;
+        attach(watch,node);
+        watch->changed=true;
+    }
+    if (known->state!=0&&known->state!=stat->state) {
+        watch->changed=true;
+    }
+    known->state=stat->state;
+    known->started=stat->starttime;
+    known->generation=watch->generation;
+    return true;
+}
+
+/*
+    scanProcesses lists /proc once and reads the stat of every
+    process with the allocation-free readProcStat(). A process not
+    known yet is added; a known one is updated by updateProcess().
+    Known processes missing from the listing have exited and are
+    removed.
+*/
+void scanProcesses(Watch * watch) {
+    ++watch->generation;
+    DIR * proc=opendir("/proc");
+    if (proc==nullptr) {
+        return;
+    }
+    size_t capacity=16;
+    size_t number=0;
+    PIDNode ** added=(PIDNode**)malloc(sizeof(PIDNode*)*capacity);
+    struct dirent * entry=nullptr;
+    ProcStat stat;
+    while ((entry=readdir(proc))!=nullptr) {
+        if (entry->d_name[0]<'0'||entry->d_name[0]>'9'||!readProcStat(atoi(entry->d_name),&stat)) {
+            continue;
+        }
+        WatchEntry * known=findWatchEntry(watch,stat.pid);
+        if (known!=nullptr&&updateProcess(watch,known,&stat)) {
+            continue;
+        }
+        if (known!=nullptr) {
+            removeProcess(watch,stat.pid);
+        }
+        PIDNode * node=(PIDNode*)malloc(sizeof(PIDNode));
+        node->PID=stat.pid;
+        node->PPID=stat.ppid;
+        node->name=strdup(stat.comm);
+        node->child=nullptr;
+        node->next=nullptr;
+        if (number==capacity) {
+            capacity*=2;
+            added=(PIDNode**)realloc(added,sizeof(PIDNode*)*capacity);
+        }
+        known=insertWatchEntry(watch,node);
+        known->state=stat.state;
+        known->started=stat.starttime;
+        added[number++]=node;
+    }
+    closedir(proc);
+    // attach only once every new parent is known, backwards so that each
+    // insertion into a listing in ascending order happens at the head.
+    size_t i=number;
+    while (i!=0) {
+        attach(watch,added[--i]);
+    }
+    watch->changed=watch->changed||number!=0;
+    free(added);
+    capacity=16;
+    number=0;
+    pid_t * gone=(pid_t*)malloc(sizeof(pid_t)*capacity);
+    for (i=0;i!=watch->bucketNumber;++i) {
+        WatchEntry * known=watch->buckets[i];
+        for (;known!=nullptr;known=known->next) {
+            if (known->generation==watch->generation) {
+                continue;
+            }
+            if (number==capacity) {
+                capacity*=2;
+                gone=(pid_t*)realloc(gone,sizeof(pid_t)*capacity);
+            }
+            gone[number++]=known->node->PID;
+        }
+    }
+    for (i=0;i!=number;++i) {
+        removeProcess(watch,gone[i]);
+    }
+    free(gone);
+}
+
+/*
+    applyEvent applies one proc connector event. Events of threads
+    other than the main one are ignored.
+*/
+void applyEvent(Watch * watch, struct proc_event * event) {
+    switch (event->what) {
+    case PROC_EVENT_FORK:
+        if (event->event_data.fork.child_pid==event->event_data.fork.child_tgid) {
+            forkProcess(watch,event->event_data.fork.parent_tgid,event->event_data.fork.child_tgid);
+        }
+        break;
+    case PROC_EVENT_EXEC:
+        renameProcess(watch,event->event_data.exec.process_tgid,nullptr);
+        break;
+    case PROC_EVENT_COMM:
+        if (event->event_data.comm.process_pid==event->event_data.comm.process_tgid) {
+            char name[sizeof(event->event_data.comm.comm)+1];
+            memcpy(name,event->event_data.comm.comm,sizeof(event->event_data.comm.comm));
+            name[sizeof(event->event_data.comm.comm)]='\0';
+            renameProcess(watch,event->event_data.comm.process_tgid,name);
+        }
+        break;
+    case PROC_EVENT_EXIT:
+        if (event->event_data.exit.process_pid==event->event_data.exit.process_tgid) {
+            removeProcess(watch,event->event_data.exit.process_tgid);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+    readEvents applies every pending connector event. It returns
+    false when the socket overflowed and events were lost, in which
+    case the caller resynchronizes with a /proc listing.
+*/
+bool readEvents(Watch * watch) {
+    char buffer[WATCH_EVENT_BUFFER] __attribute__((aligned(NLMSG_ALIGNTO)));
+    while (true) {
+        ssize_t size=recv(watch->connector,buffer,sizeof(buffer),0);
+        if (size==-1) {
+            return errno!=ENOBUFS;
+        }
+        int length=(int)size;
+        struct nlmsghdr * header=(struct nlmsghdr*)buffer;
+        for (;NLMSG_OK(header,length);header=NLMSG_NEXT(header,length)) {
+            if (header->nlmsg_type==NLMSG_ERROR||header->nlmsg_type==NLMSG_NOOP) {
+                continue;
+            }
+            struct cn_msg * message=(struct cn_msg*)NLMSG_DATA(header);
+            if (message->id.idx==CN_IDX_PROC&&message->id.val==CN_VAL_PROC) {
+                applyEvent(watch,(struct proc_event*)message->data);
+            }
+        }
+    }
+}
+
+/*
+    openConnector subscribes to the proc connector. It needs
+    CAP_NET_ADMIN and only reports anything in the initial network
+    namespace, so a probe child is forked and its fork event must
+    arrive within WATCH_PROBE_MS. It returns the socket or -1.
+*/
+int openConnector() {
+    int fd=socket(PF_NETLINK,SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC,NETLINK_CONNECTOR);
+    if (fd==-1) {
+        return -1;
+    }
+    struct sockaddr_nl address;
+    memset(&address,0,sizeof(address));
+    address.nl_family=AF_NETLINK;
+    address.nl_groups=CN_IDX_PROC;
+    char request[NLMSG_SPACE(sizeof(struct cn_msg)+sizeof(enum proc_cn_mcast_op))] __attribute__((aligned(NLMSG_ALIGNTO)));
+    memset(request,0,sizeof(request));
+    struct nlmsghdr * header=(struct nlmsghdr*)request;
+    header->nlmsg_len=NLMSG_LENGTH(sizeof(struct cn_msg)+sizeof(enum proc_cn_mcast_op));
+    header->nlmsg_type=NLMSG_DONE;
+    header->nlmsg_pid=0;
+    struct cn_msg * message=(struct cn_msg*)NLMSG_DATA(header);
+    message->id.idx=CN_IDX_PROC;
+    message->id.val=CN_VAL_PROC;
+    message->len=sizeof(enum proc_cn_mcast_op);
+    enum proc_cn_mcast_op operation=PROC_CN_MCAST_LISTEN;
+    memcpy(message->data,&operation,sizeof(operation));
+    if (bind(fd,(struct sockaddr*)&address,sizeof(address))==-1||send(fd,request,header->nlmsg_len,0)==-1) {
+        close(fd);
+        return -1;
+    }
+    pid_t probe=fork();
+    if (probe==0) {
+        _exit(0);
+    }
+    waitpid(probe,nullptr,0);
+    struct pollfd event={fd,POLLIN,0};
+    char buffer[WATCH_EVENT_BUFFER] __attribute__((aligned(NLMSG_ALIGNTO)));
+    while (probe>0&&poll(&event,1,WATCH_PROBE_MS)==1) {
+        ssize_t size=recv(fd,buffer,sizeof(buffer),MSG_PEEK);
+        int length=(int)size;
+        struct nlmsghdr * reply=(struct nlmsghdr*)buffer;
+        for (;size>0&&NLMSG_OK(reply,length);reply=NLMSG_NEXT(reply,length)) {
+            struct cn_msg * data=(struct cn_msg*)NLMSG_DATA(reply);
+            struct proc_event * procEvent=(struct proc_event*)data->data;
+            if (reply->nlmsg_type!=NLMSG_ERROR&&procEvent->what==PROC_EVENT_FORK&&
+                procEvent->event_data.fork.child_pid==probe) {
+                return fd;
+            }
+        }
+        recv(fd,buffer,sizeof(buffer),0);
+    }
+    close(fd);
+    return -1;
+}
+
+/*
+    drawFrame renders the tree rooted at root and rewrites only the
+    rows of the terminal that differ from the previous frame, all
+    with a single write().
+*/
+void drawFrame(Watch * watch, PIDNode * root, int interval) {
+    TextBuffer frame;
+    initText(&frame);
+    appendFormat(&frame,"Every %gs: %zu processes, updated from %s. Ctrl-C to stop.\n",interval/1000.0,
+                 watch->size,watch->connector!=-1?"the proc connector":"/proc listings");
+    renderTree(root,&frame);
+    size_t capacity=64;
+    size_t number=0;
+    char ** lines=(char**)malloc(sizeof(char*)*capacity);
+    char * line=frame.data;
+    char * end=frame.data+frame.size;
+    while (line<end) {
+        char * newline=(char*)memchr(line,'\n',end-line);
+        *newline='\0';
+        if (number==capacity) {
+            capacity*=2;
+            lines=(char**)realloc(lines,sizeof(char*)*capacity);
+        }
+        lines[number++]=line;
+        line=newline+1;
+    }
+    TextBuffer output;
+    initText(&output);
+    size_t i=0;
+    for (i=0;i!=number;++i) {
+        if (i<watch->lineNumber&&strcmp(lines[i],watch->lines[i])==0) {
+            continue;
+        }
+        appendFormat(&output,"\033[%zu;1H%s\033[K",i+1,lines[i]);
+    }
+    if (number<watch->lineNumber) {
+        appendFormat(&output,"\033[%zu;1H\033[J",number+1);
+    }
+    appendFormat(&output,"\033[%zu;1H",number+1);
+    write(STDOUT_FILENO,output.data,output.size);
+    freeText(&output);
+    freeText(&watch->frame);
+    free(watch->lines);
+    watch->frame=frame;
+    watch->lines=lines;
+    watch->lineNumber=number;
+    watch->changed=false;
+}
+
+long nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return now.tv_sec*1000+now.tv_nsec/1000000;
+}
+
+/*
+    watchTree keeps every process in a Watch and redraws the subtree
+    of pid every interval milliseconds, only if anything changed.
+    With the proc connector a refresh costs O(events), reading /proc
+    only for exec'd processes and the orphans of exited ones; without
+    it /proc is listed once per interval and only new processes are
+    read. It stops at SIGINT, when pid exits or, in an interactive
+    shell, at a line on the terminal, which is taken through the
+    reader of the shell. A script or a pipe is never read from, so
+    the lines after "viewtree --watch" are left to the shell.
+*/
+void watchTree(pid_t pid, int interval) {
+    Watch watch;
+    watch.bucketNumber=WATCH_BUCKETS;
+    watch.buckets=(WatchEntry**)calloc(watch.bucketNumber,sizeof(WatchEntry*));
+    watch.size=0;
+    watch.generation=0;
+    watch.changed=true;
+    initText(&watch.frame);
+    watch.lines=nullptr;
+    watch.lineNumber=0;
+    // subscribe first so that nothing is missed between the listing and the events.
+    watch.connector=openConnector();
+    scanProcesses(&watch);
+    write(STDOUT_FILENO,"\033[H\033[2J",7);
+    sigint_flag=0;
+    if (interval<WATCH_MIN_INTERVAL) {
+        interval=WATCH_MIN_INTERVAL;
+    }
+    LineReader * reader=interactiveReader();
+    bool stop=false;
+    while (!stop) {
+        PIDNode * root=findWatchNode(&watch,pid);
+        if (root==nullptr) {
+            break;
+        }
+        if (watch.changed) {
+            drawFrame(&watch,root,interval);
+        }
+        long deadline=nowMs()+interval;
+        long remaining=interval;
+        do {
+            struct pollfd events[2]={{watch.connector,POLLIN,0},{reader!=nullptr?reader->fd:-1,POLLIN,0}};
+            int ready=poll(events,2,(int)remaining);
+            if (ready>0&&events[1].revents!=0) {
+                fillReader(reader);
+                stop=reader->eof||takeLine(reader)!=nullptr;
+            }
+            if (sigint_flag) {
+                stop=true;
+            } else if (ready>0&&events[0].revents!=0&&!readEvents(&watch)) {
+                scanProcesses(&watch);
+            }
+            remaining=deadline-nowMs();
+        } while (!stop&&remaining>0);
+        if (watch.connector==-1&&!stop) {
+            scanProcesses(&watch);
+        }
+    }
+    sigint_flag=0;
+    if (watch.connector!=-1) {
+        close(watch.connector);
+    }
+    size_t i=0;
+    for (i=0;i!=watch.bucketNumber;++i) {
+        WatchEntry * entry=watch.buckets[i];
+        while (entry!=nullptr) {
+            WatchEntry * next=entry->next;
+            free(entry->node->name);
+            free(entry->node);
+            free(entry);
+            entry=next;
+        }
+    }
+    free(watch.buckets);
+    free(watch.lines);
+    freeText(&watch.frame);
+}
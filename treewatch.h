@@ -0,0 +1,15 @@
+#ifndef TREEWATCH_H
+#define TREEWATCH_H
+#include <sys/types.h>
+#include <limits.h>
+
+#define WATCH_MIN_INTERVAL 10
+#define WATCH_MAX_INTERVAL INT_MAX
+
+/*
+    watchTree redraws the process tree rooted at pid every interval
+    milliseconds, from WATCH_MIN_INTERVAL to WATCH_MAX_INTERVAL, until
+    SIGINT or a line on the terminal.
+*/
+void watchTree(pid_t pid, int interval);
+#endif //TREEWATCH_H
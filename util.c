@@ -1,43 +1,70 @@
 #include "util.h"
+#include "procstat.h"
+#include "redirect.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <errno.h>
 
 
 /*
-    returns true if the input is all space and false if not.
+    newArena creates an arena whose header lives in its first block,
+    so a small Line costs a single malloc.
 */
-bool allSpace(char * input) {
-    int i=0;
-    while (input[i]!='\0') {
-        if (input[i]!=' ') {
-            return false;
-        }
-        ++i;
+Arena * newArena() {
+    ArenaBlock * block=(ArenaBlock*)malloc(sizeof(ArenaBlock)+ARENA_BLOCK_SIZE);
+    block->next=nullptr;
+    block->size=ARENA_BLOCK_SIZE;
+    block->used=sizeof(Arena);
+    Arena * arena=(Arena*)block->data;
+    arena->head=block;
+    return arena;
+}
+
+/*
+    It returns size bytes aligned to a pointer from the arena. A new
+    block is chained in when the current one is full; requests larger
+    than a block get a block of their own.
+*/
+void * arenaAlloc(Arena * arena, size_t size) {
+    size=(size+sizeof(void*)-1)&~(sizeof(void*)-1);
+    ArenaBlock * block=arena->head;
+    if (block->used+size>block->size) {
+        size_t blockSize=size>ARENA_BLOCK_SIZE?size:ARENA_BLOCK_SIZE;
+        block=(ArenaBlock*)malloc(sizeof(ArenaBlock)+blockSize);
+        block->size=blockSize;
+        block->used=0;
+        block->next=arena->head;
+        arena->head=block;
     }
-    return true;
+    void * result=block->data+block->used;
+    block->used+=size;
+    return result;
 }
 
 /*
-    It returns the number of non-space string in inp with delimiter.
-    If flag is true, the separated strings will be stored into output.
+    It copies size characters of input into the arena and terminates them.
 */
-int split_input(char *inp, char **output, char *delimiter, bool flag) {
-    int i = 0;
-    char *input = strdup(inp);
-    char *tmp = strtok(input, delimiter);
-    while (tmp) {
-        if (!allSpace(tmp)) {
-            if (flag) {
-                output[i] = strdup(tmp);
-            }
-            ++i;
-        }
-        tmp = strtok(nullptr, delimiter);
+char * arenaStrndup(Arena * arena, const char * input, size_t size) {
+    char * result=(char*)arenaAlloc(arena,size+1);
+    memcpy(result,input,size);
+    result[size]='\0';
+    return result;
+}
+
+/*
+    release every block of the arena, the header included.
+*/
+void freeArena(Arena * arena) {
+    ArenaBlock * block=arena->head;
+    while (block) {
+        ArenaBlock * next=block->next;
+        free(block);
+        block=next;
     }
-    free(input);
-    return i;
 }
 
 /*
@@ -55,60 +82,119 @@ char * copy(char * buffer,ssize_t i, ssize_t j) {
 }
 
 /*
-    It reads /proc/inp/stat to get the statistics of process inp.
-    And then it create a new PIDNode to store the relevant information
-    and returns it.
+    It reads /proc/inp/stat with readProcStat to get the statistics
+    of process inp. And then it create a new PIDNode to store the
+    relevant information and returns it.
 */
 PIDNode * buildPIDNode(pid_t inp) {
-    pid_t pid=0;
-    char * name=(char*)malloc(sizeof(char)*MAX_PROC_FILE_PATH);
-    unsigned long ut, st;
-    pid_t ppid;
-
-    char str[MAX_PROC_FILE_PATH];
-    sprintf(str, "/proc/%d/stat",inp);
-    FILE *file = fopen(str, "r");
-    if (file == NULL) {
+    ProcStat stat;
+    if (!readProcStat(inp,&stat)) {
         return nullptr;
     }
-    int z;
-    unsigned long h;
-    char stat;
-    fscanf(file, "%d %s %c %d %d %d %d %d %u %lu %lu %lu %lu %lu %lu", &pid, name, &stat, &ppid, &z, &z, &z, &z,
-           (unsigned *)&z, &h, &h, &h, &h, &ut, &st);
-    fclose(file);
-    char * newName=copy(name,1,strlen(name)-1);
-    free(name);
     PIDNode * result = (PIDNode*)(malloc(sizeof(PIDNode)));
-    result->PPID=ppid;
-    result->PID=pid;
-    result->name=newName;
+    result->PPID=stat.ppid;
+    result->PID=stat.pid;
+    result->name=strdup(stat.comm);
     result->child=nullptr;
     result->next=nullptr;
     return result;
 }
 
 /*
-    release all memory allocated for cmd.
+    release all memory allocated for line. Every Command and
+    argument lives in the arena of the line; the memfds of its
+    here-docs are closed.
+*/
+void freeLine(Line * line) {
+    closeHereDocs(line);
+    freeArena(line->arena);
+}
+
+void initText(TextBuffer * text) {
+    text->capacity=4096;
+    text->data=(char*)malloc(text->capacity);
+    text->size=0;
+}
+
+/*
+    It makes room for size more bytes, doubling the buffer as needed.
 */
-void freeCommand(Command * cmd) {
-    int i=0;
-    for (;i!=cmd->argc;++i) {
-        free(cmd->argv[i]);
+void reserveText(TextBuffer * text, size_t size) {
+    if (text->size+size+1<=text->capacity) {
+        return;
     }
-    free(cmd);
+    while (text->size+size+1>text->capacity) {
+        text->capacity*=2;
+    }
+    text->data=(char*)realloc(text->data,text->capacity);
+}
+
+void appendText(TextBuffer * text, const char * data, size_t size) {
+    reserveText(text,size);
+    memcpy(text->data+text->size,data,size);
+    text->size+=size;
+    text->data[text->size]='\0';
+}
+
+void appendChars(TextBuffer * text, char c, size_t count) {
+    reserveText(text,count);
+    memset(text->data+text->size,c,count);
+    text->size+=count;
+    text->data[text->size]='\0';
+}
+
+void appendFormat(TextBuffer * text, const char * format, ...) {
+    va_list args;
+    va_start(args,format);
+    int size=vsnprintf(nullptr,0,format,args);
+    va_end(args);
+    reserveText(text,size);
+    va_start(args,format);
+    vsnprintf(text->data+text->size,size+1,format,args);
+    va_end(args);
+    text->size+=size;
+}
+
+void freeText(TextBuffer * text) {
+    free(text->data);
+    text->data=nullptr;
+    text->size=0;
+    text->capacity=0;
 }
 
 /*
-    release all memory allocated for line.
+    writeText writes all of text to fd, after anything printf has
+    buffered.
 */
-void freeLine(Line * line) {
-    Command * iterator = line->head;
-    Command * temp=nullptr;
-    while (iterator) {
-        temp = iterator;
-        iterator=iterator->next;
-        freeCommand(temp);
+void writeText(int fd, TextBuffer * text) {
+    fflush(stdout);
+    size_t written=0;
+    while (written<text->size) {
+        ssize_t result=write(fd,text->data+written,text->size-written);
+        if (result<=0) {
+            return;
+        }
+        written+=result;
     }
-    free(line);
-}
\ No newline at end of file
+}
+
+/*
+    moveHigh moves fd to the lowest free fd from REDIRECT_FD_BASE on,
+    closing the original, and returns it. Every fd the shell keeps
+    open while a command runs lives there, since only the fds below
+    REDIRECT_FD_BASE can be redirected: a built-in redirected in the
+    shell or a child applying its redirections never overwrites the
+    signalfd, the epoll fd, the script or the history, and applying
+    the pairs of a redirection in order never overwrites the from fd
+    of a later one. -1 is returned as is.
+*/
+int moveHigh(int fd) {
+    if (fd==-1||fd>=REDIRECT_FD_BASE) {
+        return fd;
+    }
+    int result=fcntl(fd,F_DUPFD_CLOEXEC,REDIRECT_FD_BASE);
+    int savedErrno=errno;
+    close(fd);
+    errno=savedErrno;
+    return result;
+}
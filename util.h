@@ -16,32 +16,121 @@
 #define bool int
 #endif
 
-#define BUFFER_SIZE 1024
-#define MAX_ARGS_NUMBER 30
-#define pipe_out(pipefd) close(pipefd[0]);dup2(pipefd[1],STDOUT_FILENO);close(pipefd[1]);
-#define pipe_in(pipefd) close(pipefd[1]);dup2(pipefd[0], STDIN_FILENO);close(pipefd[0]);
-#define close_pipe(pipefd) close(pipefd[0]);close(pipefd[1]);
+#define ARENA_BLOCK_SIZE 4096
 #define EXIT_TYPE -1
 #define VIEWTREE_TYPE -2
+#define HASH_TYPE -3
+#define JOBS_TYPE -4
+#define FG_TYPE -5
+#define BG_TYPE -6
+#define WAIT_TYPE -7
+#define BENCH_TYPE -8
+#define HISTORY_TYPE -9
+#define BUILTIN_TYPE -10
+#define PARALLEL_TYPE 2
 #define TIMEX_TYPE 1
 #define NORMAL_TYPE 0
 #define MAX_PROC_FILE_PATH 256
-#define MAX_PIPE_NUMBER 5
+#define REDIRECT_MAX 16
+#define REDIRECT_FD_BASE 10
+#define REDIRECT_INPUT 0
+#define REDIRECT_OUTPUT 1
+#define REDIRECT_APPEND 2
+#define REDIRECT_DUP 3
+#define REDIRECT_HERE_STRING 4
+#define REDIRECT_HERE_DOC 5
 
 #include <sys/types.h>
 
+typedef struct ArenaBlock {
+    struct ArenaBlock * next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock * head;
+} Arena;
+
+/*
+    A Redirect of a command, applied in the order they were written:
+    fd is opened on word (a path) or, for REDIRECT_DUP, made a copy
+    of source. A here-string is word itself; a here-doc is the lines
+    up to the delimiter word, collected in memfd until complete.
+*/
+typedef struct Redirect {
+    int type;
+    int fd;
+    int source;
+    char * word;
+    int memfd;
+    bool complete;
+    struct Redirect * next;
+    struct Redirect * nextHereDoc;
+} Redirect;
+
+/*
+    The ResourceLimits of a line run with "limit": memory in bytes,
+    cpu in CPUs (1.5 is one and a half), the number of processes and
+    of open files. A negative value leaves the resource unlimited.
+*/
+typedef struct ResourceLimits {
+    long long memory;
+    double cpu;
+    long pids;
+    long files;
+} ResourceLimits;
+
+/*
+    The Placement of a command given by its "@" modifiers: the CPUs it
+    may run on, one bit per CPU as in a cpu_set_t, the NUMA node its
+    memory is bound to, its nice value and its scheduling policy with
+    the priority of a real-time one. hasCpus and hasNice tell whether
+    they are set, node and policy are -1 when they are not.
+*/
+#define PLACEMENT_CPUS 1024
+typedef struct Placement {
+    unsigned long cpus[PLACEMENT_CPUS/(8*sizeof(unsigned long))];
+    bool hasCpus;
+    int node;
+    bool hasNice;
+    int nice;
+    int policy;
+    int priority;
+} Placement;
+
 typedef struct Command {
     int argc;
-    char * argv[MAX_ARGS_NUMBER];
+    char ** argv;
     struct Command *next;
+    Redirect * redirects;
+    Placement * placement;
 } Command;
 
 typedef struct Line {
+    Arena * arena;
+    char * text;
+    char * events;
     int type;
     int background;
     Command * head;
+    int branchNumber;
+    Command ** branch;
+    Redirect * hereDocs;
+    ResourceLimits * limits;
+    bool spread;
 } Line;
 
+/*
+    TextBuffer collects output which is then written at once.
+*/
+typedef struct TextBuffer {
+    char * data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
 typedef struct PIDNode {
     pid_t PID;
     pid_t PPID;
@@ -50,10 +139,19 @@ typedef struct PIDNode {
     struct PIDNode *child;
 } PIDNode;
 
-bool allSpace(char *input);
-int split_input(char *input, char **output, char *delimiter, bool flag);
+Arena * newArena();
+void * arenaAlloc(Arena * arena, size_t size);
+char * arenaStrndup(Arena * arena, const char * input, size_t size);
+void freeArena(Arena * arena);
 PIDNode * buildPIDNode(pid_t inp);
 char * copy(char * buffer,ssize_t i, ssize_t j);
-void freeCommand(Command * cmd);
 void freeLine(Line * line);
+void initText(TextBuffer * text);
+void reserveText(TextBuffer * text, size_t size);
+void appendText(TextBuffer * text, const char * data, size_t size);
+void appendChars(TextBuffer * text, char c, size_t count);
+void appendFormat(TextBuffer * text, const char * format, ...);
+void freeText(TextBuffer * text);
+void writeText(int fd, TextBuffer * text);
+int moveHigh(int fd);
 #endif
\ No newline at end of file
@@ -1,226 +1,615 @@
-#include "util.h"
+#include "viewtree.h"
+#include "treewatch.h"
+#include "procscan.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
+#include <dirent.h>
 
 
 
 /*
-    If the last element of buffer is not \n, i.e., 
-    reading is incomplete, getLastOne returns the 
-    last incomplete part of PID.
+    ProcIndex maps a PID to its position in the array of
+    PIDNodes collected from /proc. It is an open addressing
+    hash table whose capacity is a power of two and at least
+    twice the number of processes, so every lookup is O(1).
 */
-char * getLastOne(char * buffer) {
-    ssize_t i=BUFFER_SIZE-1;
-    while (buffer[i]!='\n') {
-        --i;
-    }
-    ssize_t size=BUFFER_SIZE-i-1;
-    char * lastOne=(char*)malloc(sizeof(char)*(size+1));
-    ssize_t j=0;
-    while (j!=size) {
-        lastOne[j]=buffer[i+j+1];
-        ++j;
+typedef struct ProcIndex {
+    int capacity;
+    pid_t * keys;
+    int * values;
+} ProcIndex;
+
+void initIndex(ProcIndex * index, int size) {
+    index->capacity=16;
+    while (index->capacity<size*2) {
+        index->capacity<<=1;
     }
-    lastOne[j]='\0';
-    return lastOne;
+    index->keys=(pid_t*)calloc(index->capacity,sizeof(pid_t));
+    index->values=(int*)malloc(sizeof(int)*index->capacity);
 }
 
+void insertIndex(ProcIndex * index, pid_t pid, int position) {
+    int slot=pid&(index->capacity-1);
+    while (index->keys[slot]!=0) {
+        slot=(slot+1)&(index->capacity-1);
+    }
+    index->keys[slot]=pid;
+    index->values[slot]=position;
+}
 
+void buildIndex(ProcIndex * index, PIDNode ** nodes, int size) {
+    initIndex(index,size);
+    int i=0;
+    for (i=0;i!=size;++i) {
+        insertIndex(index,nodes[i]->PID,i);
+    }
+}
 
 /*
-    If there's a separated PID due to the BUFFER_SIZE, combine uses 
-    the lastOne part of last buffer and current buffer to create a 
-    new complete PID string.
+    returns the position of pid in the node array or -1
+    if pid was not collected.
 */
-char* combine(char * buffer,char *lastOne) {
-    ssize_t i=0;
-    while (buffer[i]!='\n') {
-        ++i;
-    }
-    ssize_t lastSize=strlen(lastOne);
-    ssize_t size=lastSize+i;
-    char * result=(char*)malloc(sizeof(char)*(size+1));
-    ssize_t j=0;
-    while (j!=lastSize) {
-        result[j]=lastOne[j];
-        ++j;
-    }
-    j=0;
-    while (j!=i) {
-        result[lastSize+j]=buffer[j];
-        buffer[j]='\n'; 
-        ++j;
+int lookupIndex(ProcIndex * index, pid_t pid) {
+    int slot=pid&(index->capacity-1);
+    while (index->keys[slot]!=0) {
+        if (index->keys[slot]==pid) {
+            return index->values[slot];
+        }
+        slot=(slot+1)&(index->capacity-1);
     }
-    result[lastSize+j]='\0';
-    free(lastOne);
-    return result;
+    return -1;
 }
 
+void freeIndex(ProcIndex * index) {
+    free(index->keys);
+    free(index->values);
+}
 
 /*
-    build a linked list from buffer with length size while updating iterator
-    and returns the head Node. It goes through the buffer and uses \n as its
-    delimiter. for each pattern, call buildPIDNode to create PIDNode.
+    scanProc reads the /proc directory once and calls buildPIDNode
+    for every process in it. It returns an array of PIDNodes and
+    stores its length into size. Processes that exit during the
+    scan are skipped.
 */
-PIDNode * buildFromBuffer(char * buffer, PIDNode** iterator,ssize_t size) {
-    PIDNode * head=nullptr;
-    if (size==BUFFER_SIZE&&buffer[size]!='\n') {
-        while(buffer[size]!='\n') {
-            --size;
+PIDNode ** scanProc(int * size) {
+    int capacity=256;
+    PIDNode ** nodes=(PIDNode**)malloc(sizeof(PIDNode*)*capacity);
+    *size=0;
+    DIR * proc=opendir("/proc");
+    if (proc==nullptr) {
+        return nodes;
+    }
+    struct dirent * entry=nullptr;
+    while ((entry=readdir(proc))!=nullptr) {
+        if (entry->d_name[0]<'0'||entry->d_name[0]>'9') {
+            continue;
+        }
+        PIDNode * node=buildPIDNode(atoi(entry->d_name));
+        if (node==nullptr) {
+            continue;
         }
+        if (*size==capacity) {
+            capacity*=2;
+            nodes=(PIDNode**)realloc(nodes,sizeof(PIDNode*)*capacity);
+        }
+        nodes[(*size)++]=node;
     }
-    ssize_t i=0;
-    ssize_t j=0;
-    while (j!=size) {
-        i=j;
-        while(buffer[j]!='\n') {
-            ++j;
+    closedir(proc);
+    return nodes;
+}
+
+/*
+    buildTree builds the process tree rooted at pid from a single
+    scan of /proc without spawning any process. It indexes the
+    collected nodes by PID, threads every node onto its parent's
+    list of children, then walks breadth-first from the root to
+    link the PIDNodes. Nodes outside the subtree are freed.
+    Everything is O(N) in the number of processes.
+*/
+PIDNode * buildTree(pid_t pid) {
+    int size=0;
+    PIDNode ** nodes=scanProc(&size);
+    ProcIndex index;
+    buildIndex(&index,nodes,size);
+    int * firstChild=(int*)malloc(sizeof(int)*(size+1));
+    int * nextSibling=(int*)malloc(sizeof(int)*(size+1));
+    char * kept=(char*)calloc(size+1,sizeof(char));
+    int i=0;
+    for (i=0;i!=size;++i) {
+        firstChild[i]=-1;
+        nextSibling[i]=-1;
+    }
+    // walk backwards so that children end up in ascending PID order.
+    for (i=size-1;i>=0;--i) {
+        int parent=lookupIndex(&index,nodes[i]->PPID);
+        if (parent!=-1&&parent!=i) {
+            nextSibling[i]=firstChild[parent];
+            firstChild[parent]=i;
         }
-        char * pid=copy(buffer,i,j);
-        if ((*iterator)==nullptr) {
-            (*iterator)=buildPIDNode(atoi(pid));
-            head=*iterator;
-        } else {
-            (*iterator)->next=buildPIDNode(atoi(pid));
-            if ((*iterator)->next!=nullptr) {
-                (*iterator)=(*iterator)->next;
+    }
+    PIDNode * root=nullptr;
+    int rootIndex=lookupIndex(&index,pid);
+    if (rootIndex!=-1) {
+        root=nodes[rootIndex];
+        int * queue=(int*)malloc(sizeof(int)*size);
+        int head=0;
+        int tail=0;
+        queue[tail++]=rootIndex;
+        kept[rootIndex]=1;
+        while (head!=tail) {
+            int current=queue[head++];
+            PIDNode * last=nullptr;
+            int child=firstChild[current];
+            while (child!=-1) {
+                if (last==nullptr) {
+                    nodes[current]->child=nodes[child];
+                } else {
+                    last->next=nodes[child];
+                }
+                last=nodes[child];
+                kept[child]=1;
+                queue[tail++]=child;
+                child=nextSibling[child];
             }
         }
-        ++j;
+        free(queue);
     }
-    return head;
+    for (i=0;i!=size;++i) {
+        if (!kept[i]) {
+            free(nodes[i]->name);
+            free(nodes[i]);
+        }
+    }
+    free(kept);
+    free(nextSibling);
+    free(firstChild);
+    freeIndex(&index);
+    free(nodes);
+    return root;
 }
 
 
 /*
-    getChildren returns a list of PIDNodes, which are
-    the children of process specified by pid. It forks 
-    a child process to execute pgrep -P pid and uses pipe
-    to get the result. The parent process reads all input
-    from child process and generates a list of PIDNodes using
-    buildFromBuffer;
+    TreeFrame is an entry of the explicit stack of renderTree: node is
+    printed at column, after indenting a new line if newLine is set.
 */
+typedef struct TreeFrame {
+    PIDNode * node;
+    size_t column;
+    bool newLine;
+} TreeFrame;
 
-PIDNode * getChildren(pid_t pid) {
-    int pfd[2];
-    pipe(pfd);
-    pid_t pgrepPID=0;
-    if ((pgrepPID=fork())==0) {
-        close(pfd[0]);
-        dup2(pfd[1],1);
-        char * PID=(char *)malloc(sizeof(char)*MAX_PROC_FILE_PATH);
-        sprintf(PID,"%d",pid);
-        char *command[4]={(char*)"pgrep",(char*)"-P",PID,nullptr};
-        execvp(command[0],command);
-    } else if (pgrepPID>0){
-        close(pfd[1]);
-        char *lastOne=nullptr;
-        char buffer[BUFFER_SIZE];
-        char * combined=nullptr;
-        ssize_t readSize=0;
-        PIDNode * pidList=nullptr;
+/*
+    renderTree appends the tree rooted at root to text, a process and
+    its first child on one line joined by " - ". A child other than
+    the first starts a new line indented to the column of the first
+    one. It uses an explicit stack instead of recursion so that the
+    depth of the tree does not matter.
+*/
+void renderTree(PIDNode * root, TextBuffer * text) {
+    size_t capacity=64;
+    size_t depth=0;
+    TreeFrame * stack=(TreeFrame*)malloc(sizeof(TreeFrame)*capacity);
+    stack[depth++]=(TreeFrame){root,0,false};
+    while (depth!=0) {
+        TreeFrame frame=stack[--depth];
+        if (frame.newLine) {
+            appendChars(text,' ',frame.column-3);
+            appendText(text," - ",3);
+        }
+        size_t length=strlen(frame.node->name);
+        appendText(text,frame.node->name,length);
+        PIDNode * first=frame.node->child;
+        if (first==nullptr) {
+            appendText(text,"\n",1);
+            continue;
+        }
+        appendText(text," - ",3);
+        size_t number=0;
         PIDNode * iterator=nullptr;
-        do {
-            memset(buffer,0,BUFFER_SIZE*sizeof(char));
-            readSize=read(pfd[0],buffer,BUFFER_SIZE);
-            if (readSize!=0) {
-                if (lastOne!=nullptr) {
-                    combined=buffer[0]=='\n'?lastOne:combine(buffer,lastOne);
-                    lastOne=nullptr;
-                    iterator->next=buildPIDNode(atoi(combined));
-                    if (iterator->next!=nullptr) {
-                        iterator=iterator->next;
-                    }
-                    free(combined);
-                    combined=nullptr;
-                }
-                if (pidList==nullptr) {
-                    pidList=buildFromBuffer(buffer,&iterator,readSize);
-                } else {
-                    buildFromBuffer(buffer,&iterator,readSize);
-                }
-                if (readSize==BUFFER_SIZE &&buffer[readSize-1]!='\n') {
-                    lastOne=getLastOne(buffer);
-                } else {
-                    lastOne=nullptr;
-                }
-            }
-        } while (readSize==BUFFER_SIZE);
-        return pidList;
+        for (iterator=first;iterator!=nullptr;iterator=iterator->next) {
+            ++number;
+        }
+        while (depth+number>capacity) {
+            capacity*=2;
+            stack=(TreeFrame*)realloc(stack,sizeof(TreeFrame)*capacity);
+        }
+        // push the children in reverse so that the first one is popped first.
+        size_t slot=depth+number;
+        for (iterator=first;iterator!=nullptr;iterator=iterator->next) {
+            stack[--slot]=(TreeFrame){iterator,frame.column+length+3,iterator!=first};
+        }
+        depth+=number;
     }
+    free(stack);
 }
 
 /*
-    buildTree builds the process tree in a top-down order.
-    It calls getCHildren to generate the root's children and
-    for each child calls buildTree recursively'
+    JsonFrame is an entry of the explicit stack of renderJson: node is
+    opened, after a comma if comma is set, or closed if close is set.
+*/
+typedef struct JsonFrame {
+    PIDNode * node;
+    bool close;
+    bool comma;
+} JsonFrame;
+
+/*
+    appendJsonString appends value as a quoted JSON string.
 */
-PIDNode * buildTree(PIDNode* root) {
-    root->child=getChildren(root->PID);
-    PIDNode * iterator=root->child;
-    while (iterator!=nullptr) {
-        iterator=buildTree(iterator);
-        iterator=iterator->next;
+void appendJsonString(TextBuffer * text, const char * value) {
+    appendText(text,"\"",1);
+    const char * p=value;
+    for (p=value;*p!='\0';++p) {
+        unsigned char c=(unsigned char)*p;
+        if (c=='"'||c=='\\') {
+            char escaped[2]={'\\',(char)c};
+            appendText(text,escaped,2);
+        } else if (c<0x20) {
+            appendFormat(text,"\\u%04x",c);
+        } else {
+            appendText(text,p,1);
+        }
     }
-    return root;
+    appendText(text,"\"",1);
 }
 
+/*
+    renderJson appends the tree rooted at root to text as one line of
+    JSON, every process an object {"pid","ppid","name","children"}.
+    Like renderTree it keeps its own stack, where a node with children
+    is pushed again as a close frame below them.
+*/
+void renderJson(PIDNode * root, TextBuffer * text) {
+    size_t capacity=64;
+    size_t depth=0;
+    JsonFrame * stack=(JsonFrame*)malloc(sizeof(JsonFrame)*capacity);
+    stack[depth++]=(JsonFrame){root,false,false};
+    while (depth!=0) {
+        JsonFrame frame=stack[--depth];
+        if (frame.close) {
+            appendText(text,"]}",2);
+            continue;
+        }
+        if (frame.comma) {
+            appendText(text,",",1);
+        }
+        appendFormat(text,"{\"pid\":%d,\"ppid\":%d,\"name\":",frame.node->PID,frame.node->PPID);
+        appendJsonString(text,frame.node->name);
+        PIDNode * first=frame.node->child;
+        if (first==nullptr) {
+            appendText(text,",\"children\":[]}",15);
+            continue;
+        }
+        appendText(text,",\"children\":[",13);
+        size_t number=0;
+        PIDNode * iterator=nullptr;
+        for (iterator=first;iterator!=nullptr;iterator=iterator->next) {
+            ++number;
+        }
+        while (depth+number+1>capacity) {
+            capacity*=2;
+            stack=(JsonFrame*)realloc(stack,sizeof(JsonFrame)*capacity);
+        }
+        stack[depth++]=(JsonFrame){frame.node,true,false};
+        // push the children in reverse so that the first one is popped first.
+        size_t slot=depth+number;
+        for (iterator=first;iterator!=nullptr;iterator=iterator->next) {
+            stack[--slot]=(JsonFrame){iterator,false,iterator!=first};
+        }
+        depth+=number;
+    }
+    appendText(text,"\n",1);
+    free(stack);
+}
+
+/*
+    freeTree frees the whole tree without recursion or a stack. As
+    long as root has a child, the child is rotated up to take its
+    place: root becomes the child's next sibling and takes over the
+    siblings that followed it as children. Once root has no child it
+    is freed and its next sibling follows. Every rotation takes one
+    node out of a list of children for good, so this is O(N).
+*/
+PIDNode * freeTree(PIDNode * root) {
+    while (root!=nullptr) {
+        PIDNode * child=root->child;
+        if (child!=nullptr) {
+            root->child=child->next;
+            child->next=root;
+            root=child;
+        } else {
+            PIDNode * next=root->next;
+            free(root->name);
+            free(root);
+            root=next;
+        }
+    }
+    return nullptr;
+}
 
 /*
-    print the process tree recursively.
-    First print the current process name,
-    then iterate through its children and call 
-    printTree recursively.
+    formatSize writes bytes into buffer as K, M or G.
 */
-void printTree(PIDNode * root) {
-    printf("%s",root->name);
-    PIDNode * iterator=root->child;
-    if (iterator!=nullptr) {
-        printf(" - ");
+void formatSize(unsigned long long bytes, char * buffer, size_t size) {
+    if (bytes<(1ULL<<20)) {
+        snprintf(buffer,size,"%lluK",bytes>>10);
+    } else if (bytes<(1ULL<<30)) {
+        snprintf(buffer,size,"%.1fM",bytes/1048576.0);
     } else {
-        printf("\n");
+        snprintf(buffer,size,"%.1fG",bytes/1073741824.0);
     }
-    if (iterator!=nullptr) {
-        printTree(iterator);
-        iterator=iterator->next;
+}
+
+/*
+    SystemTree holds the samples of one scan linked by position:
+    firstChild/nextSibling give the children of a sample in ascending
+    PID order, and the total arrays hold the sums over its subtree.
+*/
+typedef struct SystemTree {
+    ProcSample * samples;
+    int size;
+    int * parent;
+    int * firstChild;
+    int * nextSibling;
+    double * cpu;
+    unsigned long long * totalRss;
+    double * totalCpu;
+    long * totalThreads;
+} SystemTree;
+
+/*
+    CPU% is the lifetime average of ps(1): the CPU time of a process
+    over the time since it started.
+*/
+double cpuPercent(ProcSample * sample, double uptime, long hz) {
+    double elapsed=uptime-(double)sample->startTicks/hz;
+    if (elapsed<=0) {
+        return 0;
     }
-    while (iterator!=nullptr) {
-        ssize_t j=0;
-        for(j=0;j!=strlen(root->name);++j) {
-            printf(" ");
+    return 100.0*sample->cpuTicks/hz/elapsed;
+}
+
+double readUptime() {
+    double uptime=0;
+    FILE * file=fopen("/proc/uptime","r");
+    if (file!=nullptr) {
+        if (fscanf(file,"%lf",&uptime)!=1) {
+            uptime=0;
         }
-        printf(" - ");
-        printTree(iterator);
-        iterator=iterator->next;
+        fclose(file);
     }
+    return uptime;
 }
 
+/*
+    aggregateTree visits the subtrees of the roots breadth-first, so
+    that every process comes after its parent in order, then walks
+    order backwards adding each total into the parent's. It returns
+    the number of processes visited.
+*/
+int aggregateTree(SystemTree * tree, int * roots, int rootNumber, int * order) {
+    int tail=0;
+    int head=0;
+    int i=0;
+    for (i=0;i!=rootNumber;++i) {
+        order[tail++]=roots[i];
+    }
+    while (head!=tail) {
+        int child=tree->firstChild[order[head++]];
+        for (;child!=-1;child=tree->nextSibling[child]) {
+            order[tail++]=child;
+        }
+    }
+    for (i=tail-1;i>=0;--i) {
+        int current=order[i];
+        int parent=tree->parent[current];
+        tree->totalRss[current]+=tree->samples[current].rss;
+        tree->totalCpu[current]+=tree->cpu[current];
+        tree->totalThreads[current]+=tree->samples[current].threads;
+        if (parent!=-1) {
+            tree->totalRss[parent]+=tree->totalRss[current];
+            tree->totalCpu[parent]+=tree->totalCpu[current];
+            tree->totalThreads[parent]+=tree->totalThreads[current];
+        }
+    }
+    return tail;
+}
 
 /*
-    use post-order traversal to free the whole tree.
+    renderSystem appends one row per process in depth-first order,
+    the command indented by its depth below the roots.
 */
-PIDNode * freeTree(PIDNode * root) {
-    if (root!=nullptr) {
-        freeTree(root->next);
-        freeTree(root->child);
-        free(root->name);
-        free(root);
+void renderSystem(SystemTree * tree, int * roots, int rootNumber, TextBuffer * text) {
+    appendFormat(text,"%7s %c %5s %8s %6s %7s %8s %7s  %s\n",
+        "PID",'S',"THR","RSS","CPU%","SUB-THR","SUB-RSS","SUB-CPU","COMMAND");
+    int * stack=(int*)malloc(sizeof(int)*(tree->size+1));
+    int * depths=(int*)malloc(sizeof(int)*(tree->size+1));
+    int top=0;
+    int i=0;
+    for (i=rootNumber-1;i>=0;--i) {
+        depths[top]=0;
+        stack[top++]=roots[i];
     }
-    return nullptr;
+    while (top!=0) {
+        --top;
+        int current=stack[top];
+        int depth=depths[top];
+        ProcSample * sample=&tree->samples[current];
+        char rss[16];
+        char totalRss[16];
+        formatSize(sample->rss,rss,sizeof(rss));
+        formatSize(tree->totalRss[current],totalRss,sizeof(totalRss));
+        appendFormat(text,"%7d %c %5d %8s %6.1f %7ld %8s %7.1f  ",
+            sample->pid,sample->state,sample->threads,rss,tree->cpu[current],
+            tree->totalThreads[current],totalRss,tree->totalCpu[current]);
+        if (depth>0) {
+            appendChars(text,' ',2*(depth-1));
+            appendText(text,"\\_ ",3);
+        }
+        appendFormat(text,"%s\n",sample->name);
+        // push the children in reverse so that the first one is popped first.
+        int number=0;
+        int child=tree->firstChild[current];
+        for (;child!=-1;child=tree->nextSibling[child]) {
+            ++number;
+        }
+        int slot=top+number;
+        for (child=tree->firstChild[current];child!=-1;child=tree->nextSibling[child]) {
+            --slot;
+            stack[slot]=child;
+            depths[slot]=depth+1;
+        }
+        top+=number;
+    }
+    free(depths);
+    free(stack);
 }
 
 /*
-    viewTree firstly builds a PIDNode using current pid.
-    Then it builds the whole process tree using this node.
-    After calling the printTree, it frees the memory allocated
-    and return.
+    viewSystem prints the subtree of pid, or every process when pid
+    is 0, with the state, thread count, RSS and CPU% of each process
+    and the same sums over its subtree. The rows are written at once.
 */
-void viewTree() {
-    PIDNode * root=buildPIDNode(getpid());
-    root = buildTree(root);
-    printTree(root);
+void viewSystem(pid_t pid) {
+    size_t scanned=0;
+    SystemTree tree;
+    tree.samples=sampleProcesses(&scanned);
+    if (tree.samples==nullptr) {
+        perror("myshell: viewtree: /proc");
+        return;
+    }
+    tree.size=(int)scanned;
+    int size=tree.size;
+    tree.parent=(int*)malloc(sizeof(int)*(size+1));
+    tree.firstChild=(int*)malloc(sizeof(int)*(size+1));
+    tree.nextSibling=(int*)malloc(sizeof(int)*(size+1));
+    tree.cpu=(double*)malloc(sizeof(double)*(size+1));
+    tree.totalRss=(unsigned long long*)calloc(size+1,sizeof(unsigned long long));
+    tree.totalCpu=(double*)calloc(size+1,sizeof(double));
+    tree.totalThreads=(long*)calloc(size+1,sizeof(long));
+    int * roots=(int*)malloc(sizeof(int)*(size+1));
+    int * order=(int*)malloc(sizeof(int)*(size+1));
+    int rootNumber=0;
+    double uptime=readUptime();
+    long hz=sysconf(_SC_CLK_TCK);
+    ProcIndex index;
+    initIndex(&index,size);
+    int i=0;
+    for (i=0;i!=size;++i) {
+        insertIndex(&index,tree.samples[i].pid,i);
+        tree.firstChild[i]=-1;
+        tree.nextSibling[i]=-1;
+        tree.cpu[i]=cpuPercent(&tree.samples[i],uptime,hz);
+    }
+    // walk backwards so that children end up in ascending PID order.
+    for (i=size-1;i>=0;--i) {
+        int parent=lookupIndex(&index,tree.samples[i].ppid);
+        if (parent==i) {
+            parent=-1;
+        }
+        tree.parent[i]=parent;
+        if (parent!=-1) {
+            tree.nextSibling[i]=tree.firstChild[parent];
+            tree.firstChild[parent]=i;
+        }
+    }
+    if (pid!=0) {
+        int root=lookupIndex(&index,pid);
+        if (root==-1) {
+            fprintf(stderr,"myshell: viewtree: %d: no such process\n",pid);
+        } else {
+            tree.parent[root]=-1;
+            roots[rootNumber++]=root;
+        }
+    } else {
+        for (i=0;i!=size;++i) {
+            if (tree.parent[i]==-1) {
+                roots[rootNumber++]=i;
+            }
+        }
+    }
+    if (rootNumber!=0) {
+        aggregateTree(&tree,roots,rootNumber,order);
+        TextBuffer text;
+        initText(&text);
+        renderSystem(&tree,roots,rootNumber,&text);
+        writeText(STDOUT_FILENO,&text);
+        freeText(&text);
+    }
+    freeIndex(&index);
+    free(order);
+    free(roots);
+    free(tree.totalThreads);
+    free(tree.totalCpu);
+    free(tree.totalRss);
+    free(tree.cpu);
+    free(tree.nextSibling);
+    free(tree.firstChild);
+    free(tree.parent);
+    free(tree.samples);
+}
+
+/*
+    viewtreeBuiltin runs "viewtree", "viewtree --json", "viewtree -a
+    [pid]" or "viewtree --watch [seconds]".
+*/
+void viewtreeBuiltin(int argc, char ** argv) {
+    if (argc==1) {
+        viewTree(false);
+    } else if (strcmp(argv[1],"--json")==0&&argc==2) {
+        viewTree(true);
+    } else if (strcmp(argv[1],"-a")==0&&argc<=3) {
+        pid_t pid=0;
+        if (argc==3) {
+            char * end=nullptr;
+            pid=(pid_t)strtol(argv[2],&end,10);
+            if (*end!='\0'||pid<=0) {
+                fprintf(stderr,"myshell: viewtree: invalid pid '%s'\n",argv[2]);
+                return;
+            }
+        }
+        viewSystem(pid);
+    } else if (strcmp(argv[1],"--watch")==0&&argc<=3) {
+        double interval=1.0;
+        char * end=nullptr;
+        if (argc==3) {
+            interval=strtod(argv[2],&end);
+        }
+        if (argc==3&&(end==argv[2]||*end!='\0'||!isfinite(interval)||
+                      interval*1000<WATCH_MIN_INTERVAL||interval*1000>WATCH_MAX_INTERVAL)) {
+            fprintf(stderr,"myshell: viewtree: invalid interval '%s', it must be from %g to %d s\n",argv[2],
+                    WATCH_MIN_INTERVAL/1000.0,WATCH_MAX_INTERVAL/1000);
+            return;
+        }
+        watchTree(getpid(),(int)(interval*1000));
+    } else {
+        fprintf(stderr,"myshell: viewtree: usage: viewtree [--json | -a [pid] | --watch [seconds]]\n");
+    }
+}
+
+/*
+    viewTree builds the process tree rooted at the current pid,
+    renders it as text or JSON into one buffer and writes it with a
+    single write(). Then it frees the memory allocated and return.
+*/
+void viewTree(bool json) {
+    PIDNode * root=buildTree(getpid());
+    if (root==nullptr) {
+        return;
+    }
+    TextBuffer text;
+    initText(&text);
+    if (json) {
+        renderJson(root,&text);
+    } else {
+        renderTree(root,&text);
+    }
+    writeText(STDOUT_FILENO,&text);
+    freeText(&text);
     root=freeTree(root);
     return;
 }
@@ -1,4 +1,10 @@
 #ifndef MYSHELL_VIEWTREE_H
 #define MYSHELL_VIEWTREE_H
-void viewTree();
+#include "util.h"
+PIDNode * buildTree(pid_t pid);
+PIDNode * freeTree(PIDNode * root);
+void renderTree(PIDNode * root, TextBuffer * text);
+void renderJson(PIDNode * root, TextBuffer * text);
+void viewTree(bool json);
+void viewtreeBuiltin(int argc, char ** argv);
 #endif //VIEWTREE_H
@@ -0,0 +1,447 @@
+#define _GNU_SOURCE
+#include "wildcard.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+
+/*
+    The record getdents64() fills its buffer with.
+*/
+typedef struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} LinuxDirent64;
+
+/*
+    DirectoryReader lists one directory with getdents64() into the
+    buffer of its depth. The buffers are kept between expansions, and
+    the walk never reads two directories of the same depth at once.
+*/
+typedef struct DirectoryReader {
+    int fd;
+    char * buffer;
+    long size;
+    long position;
+} DirectoryReader;
+
+static char * readerBuffers[WILDCARD_MAX_DEPTH];
+
+/*
+    returns the index of the ']' closing the bracket expression that
+    starts at pattern[i], or length if there is none, in which case
+    the '[' is an ordinary character. A ']' right after the '[' (or
+    after its '!' or '^') is part of the set.
+*/
+size_t bracketEnd(const char * pattern, size_t length, size_t i) {
+    ++i;
+    if (i<length&&(pattern[i]=='!'||pattern[i]=='^')) {
+        ++i;
+    }
+    if (i<length&&pattern[i]==']') {
+        ++i;
+    }
+    while (i<length&&pattern[i]!=']') {
+        ++i;
+    }
+    return i;
+}
+
+/*
+    returns true if word has a '*', a '?' or a complete '[...]'.
+*/
+bool hasWildcard(const char * word) {
+    size_t length=strlen(word);
+    size_t i=0;
+    for (i=0;i!=length;++i) {
+        if (word[i]=='*'||word[i]=='?'||(word[i]=='['&&bracketEnd(word,length,i)<length)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    matchBracket matches c against the bracket expression from
+    pattern[begin], the '[', to pattern[end], its ']': characters,
+    ranges such as a-z, and a leading '!' or '^' which negates it.
+*/
+bool matchBracket(const char * pattern, size_t begin, size_t end, char c) {
+    size_t i=begin+1;
+    bool negate=pattern[i]=='!'||pattern[i]=='^';
+    if (negate) {
+        ++i;
+    }
+    bool matched=false;
+    while (i<end) {
+        unsigned char low=(unsigned char)pattern[i];
+        unsigned char high=low;
+        if (i+2<end&&pattern[i+1]=='-') {
+            high=(unsigned char)pattern[i+2];
+            i+=3;
+        } else {
+            ++i;
+        }
+        matched=matched||((unsigned char)c>=low&&(unsigned char)c<=high);
+    }
+    return matched!=negate;
+}
+
+/*
+    matchPattern matches name against the length bytes of pattern:
+    '*' is any string, '?' any character and [...] a set. It needs
+    no allocation and no recursion: after a mismatch it only goes back
+    to the last '*', letting it take one more character.
+*/
+bool matchPattern(const char * pattern, size_t length, const char * name) {
+    size_t p=0;
+    size_t starPattern=0;
+    const char * starName=nullptr;
+    while (*name!='\0') {
+        if (p<length&&pattern[p]=='*') {
+            starPattern=++p;
+            starName=name;
+            continue;
+        }
+        bool step=false;
+        size_t next=p+1;
+        if (p<length) {
+            size_t end=pattern[p]=='['?bracketEnd(pattern,length,p):length;
+            if (pattern[p]=='?') {
+                step=true;
+            } else if (end<length) {
+                step=matchBracket(pattern,p,end,*name);
+                next=end+1;
+            } else {
+                step=pattern[p]==*name;
+            }
+        }
+        if (step) {
+            p=next;
+            ++name;
+        } else if (starName!=nullptr) {
+            p=starPattern;
+            name=++starName;
+        } else {
+            return false;
+        }
+    }
+    while (p<length&&pattern[p]=='*') {
+        ++p;
+    }
+    return p==length;
+}
+
+void initMatches(WildcardMatches * matches) {
+    initText(&matches->names);
+    matches->capacity=64;
+    matches->offsets=(size_t*)malloc(sizeof(size_t)*matches->capacity);
+    matches->number=0;
+}
+
+void freeMatches(WildcardMatches * matches) {
+    freeText(&matches->names);
+    free(matches->offsets);
+    matches->offsets=nullptr;
+    matches->number=0;
+    matches->capacity=0;
+}
+
+void addMatch(WildcardMatches * matches, TextBuffer * path, const char * name, bool slash) {
+    if (matches->number==matches->capacity) {
+        matches->capacity*=2;
+        matches->offsets=(size_t*)realloc(matches->offsets,sizeof(size_t)*matches->capacity);
+    }
+    matches->offsets[matches->number++]=matches->names.size;
+    appendText(&matches->names,path->data,path->size);
+    appendText(&matches->names,name,strlen(name));
+    if (slash) {
+        appendText(&matches->names,"/",1);
+    }
+    ++matches->names.size;
+}
+
+bool openReader(DirectoryReader * reader, int dirFd, int depth) {
+    reader->fd=openat(dirFd,".",O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (reader->fd==-1) {
+        return false;
+    }
+    if (readerBuffers[depth]==nullptr) {
+        readerBuffers[depth]=(char*)malloc(WILDCARD_BUFFER_SIZE);
+    }
+    reader->buffer=readerBuffers[depth];
+    reader->size=0;
+    reader->position=0;
+    return true;
+}
+
+/*
+    nextEntry returns the next entry of the directory other than "."
+    and "..", refilling the buffer with one getdents64() call when it
+    is used up, or nullptr at its end.
+*/
+LinuxDirent64 * nextEntry(DirectoryReader * reader) {
+    while (true) {
+        if (reader->position>=reader->size) {
+            reader->size=syscall(SYS_getdents64,reader->fd,reader->buffer,WILDCARD_BUFFER_SIZE);
+            reader->position=0;
+            if (reader->size<=0) {
+                return nullptr;
+            }
+        }
+        LinuxDirent64 * entry=(LinuxDirent64*)(reader->buffer+reader->position);
+        reader->position+=entry->d_reclen;
+        const char * name=entry->d_name;
+        if (!(name[0]=='.'&&(name[1]=='\0'||(name[1]=='.'&&name[2]=='\0')))) {
+            return entry;
+        }
+    }
+}
+
+void closeReader(DirectoryReader * reader) {
+    close(reader->fd);
+}
+
+/*
+    returns true if entry is a directory. d_type answers without a
+    stat() on file systems which fill it; a symbolic link is followed
+    unless noFollow is set, which keeps "**" out of link loops.
+*/
+bool isDirectory(int dirFd, LinuxDirent64 * entry, bool noFollow) {
+    if (entry->d_type==DT_DIR) {
+        return true;
+    }
+    if (entry->d_type!=DT_UNKNOWN&&(entry->d_type!=DT_LNK||noFollow)) {
+        return false;
+    }
+    struct stat info;
+    return fstatat(dirFd,entry->d_name,&info,noFollow?AT_SYMLINK_NOFOLLOW:0)==0&&S_ISDIR(info.st_mode);
+}
+
+/*
+    literalAffixes counts the plain characters a pattern component of
+    length bytes starts and ends with, such as "entry" and ".log" in
+    "entry*.log". A name without them is rejected by hasAffixes()
+    before matchPattern() looks at it.
+*/
+void literalAffixes(const char * component, size_t length, size_t * prefix, size_t * suffix) {
+    *prefix=0;
+    while (*prefix<length&&strchr("*?[]",component[*prefix])==nullptr) {
+        ++*prefix;
+    }
+    *suffix=0;
+    while (*suffix<length-*prefix&&strchr("*?[]",component[length-1-*suffix])==nullptr) {
+        ++*suffix;
+    }
+}
+
+bool hasAffixes(const char * component, size_t length, size_t prefix, size_t suffix, const char * name) {
+    if (strncmp(name,component,prefix)!=0) {
+        return false;
+    }
+    size_t nameLength=strlen(name);
+    return nameLength>=prefix+suffix&&memcmp(name+nameLength-suffix,component+length-suffix,suffix)==0;
+}
+
+void walkPattern(WildcardMatches * matches, int dirFd, TextBuffer * path, const char * component, int depth);
+
+/*
+    descend continues the walk in the subdirectory name of dirFd,
+    with name and a '/' appended to path.
+*/
+void descend(WildcardMatches * matches, int dirFd, TextBuffer * path, const char * name, const char * component, int depth) {
+    int fd=openat(dirFd,name,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (fd==-1) {
+        return;
+    }
+    size_t size=path->size;
+    appendText(path,name,strlen(name));
+    appendText(path,"/",1);
+    walkPattern(matches,fd,path,component,depth+1);
+    path->size=size;
+    path->data[size]='\0';
+    close(fd);
+}
+
+/*
+    walkPattern matches the components of the pattern from component
+    on in the directory dirFd, whose path relative to the start of
+    the pattern is path. A component without wildcards is opened
+    directly and only a component with them lists its directory.
+    "**" matches any number of directories, itself included, and on
+    its own at the end every file below. A name starting with '.' is
+    only matched by a component starting with '.', and a trailing '/'
+    only matches directories.
+*/
+void walkPattern(WildcardMatches * matches, int dirFd, TextBuffer * path, const char * component, int depth) {
+    if (depth==WILDCARD_MAX_DEPTH) {
+        return;
+    }
+    size_t length=strcspn(component,"/");
+    const char * rest=component+length;
+    while (*rest=='/') {
+        ++rest;
+    }
+    bool last=*rest=='\0';
+    bool slash=last&&component[length]=='/';
+    bool globstar=length==2&&component[0]=='*'&&component[1]=='*';
+    if (globstar&&!last) {
+        walkPattern(matches,dirFd,path,rest,depth);
+    }
+    char * name=strndupa(component,length);
+    if (!globstar&&!hasWildcard(name)) {
+        struct stat info;
+        if (!last) {
+            descend(matches,dirFd,path,name,rest,depth);
+        } else if (fstatat(dirFd,name,&info,slash?0:AT_SYMLINK_NOFOLLOW)==0&&(!slash||S_ISDIR(info.st_mode))) {
+            addMatch(matches,path,name,slash);
+        }
+        return;
+    }
+    size_t prefix=0;
+    size_t suffix=0;
+    literalAffixes(component,length,&prefix,&suffix);
+    DirectoryReader reader;
+    if (!openReader(&reader,dirFd,depth)) {
+        return;
+    }
+    LinuxDirent64 * entry=nullptr;
+    while ((entry=nextEntry(&reader))!=nullptr) {
+        name=entry->d_name;
+        if (name[0]=='.'&&component[0]!='.') {
+            continue;
+        }
+        if (globstar) {
+            bool directory=isDirectory(reader.fd,entry,true);
+            if (last&&(!slash||directory)) {
+                addMatch(matches,path,name,slash);
+            }
+            if (directory) {
+                descend(matches,reader.fd,path,name,component,depth);
+            }
+        } else if (hasAffixes(component,length,prefix,suffix,name)&&matchPattern(component,length,name)) {
+            if (last&&!slash) {
+                addMatch(matches,path,name,false);
+            } else if (isDirectory(reader.fd,entry,false)) {
+                if (last) {
+                    addMatch(matches,path,name,true);
+                } else {
+                    descend(matches,reader.fd,path,name,rest,depth);
+                }
+            }
+        }
+    }
+    closeReader(&reader);
+}
+
+int comparePaths(const void * a, const void * b) {
+    return strcmp(*(char * const *)a,*(char * const *)b);
+}
+
+/*
+    sortPaths sorts the number paths of keys, whose first depth bytes
+    are the same, in strcmp() order. It is a most significant byte
+    radix sort: the paths are distributed by their byte at depth
+    through scratch and every bucket goes on from the next byte,
+    after the bytes all of them share have been skipped. A few paths
+    are sorted by insertion, and buckets nested deeper than
+    WILDCARD_RADIX_LEVELS by qsort(), which bounds the stack.
+*/
+void sortPaths(char ** keys, size_t number, size_t depth, char ** scratch, int level) {
+    if (number<WILDCARD_INSERTION_SORT) {
+        size_t i=1;
+        for (i=1;i<number;++i) {
+            char * key=keys[i];
+            size_t j=i;
+            while (j>0&&strcmp(keys[j-1]+depth,key+depth)>0) {
+                keys[j]=keys[j-1];
+                --j;
+            }
+            keys[j]=key;
+        }
+        return;
+    }
+    if (level==WILDCARD_RADIX_LEVELS) {
+        qsort(keys,number,sizeof(char*),comparePaths);
+        return;
+    }
+    size_t shared=SIZE_MAX;
+    size_t i=0;
+    for (i=1;i!=number&&shared!=0;++i) {
+        size_t j=0;
+        while (j<shared&&keys[0][depth+j]!='\0'&&keys[0][depth+j]==keys[i][depth+j]) {
+            ++j;
+        }
+        shared=j;
+    }
+    depth+=shared;
+    size_t starts[256];
+    memset(starts,0,sizeof(starts));
+    for (i=0;i!=number;++i) {
+        ++starts[(unsigned char)keys[i][depth]];
+    }
+    if (starts[0]==number) {
+        return;
+    }
+    int c=0;
+    for (c=1;c!=256;++c) {
+        starts[c]+=starts[c-1];
+    }
+    for (i=number;i--!=0;) {
+        scratch[--starts[(unsigned char)keys[i][depth]]]=keys[i];
+    }
+    memcpy(keys,scratch,sizeof(char*)*number);
+    for (c=1;c!=256;++c) {
+        size_t end=c==255?number:starts[c+1];
+        if (end-starts[c]>1) {
+            sortPaths(keys+starts[c],end-starts[c],depth+1,scratch,level+1);
+        }
+    }
+}
+
+/*
+    expandWildcard adds the paths matching pattern to matches, sorted
+    once they are all found with a single sortPaths(), and returns how
+    many there are. Paths keep the form of the pattern: relative ones
+    start from the current directory and an absolute pattern gives
+    absolute paths.
+*/
+size_t expandWildcard(const char * pattern, WildcardMatches * matches) {
+    size_t first=matches->number;
+    bool absolute=pattern[0]=='/';
+    int dirFd=open(absolute?"/":".",O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+    if (dirFd==-1) {
+        return 0;
+    }
+    TextBuffer path;
+    initText(&path);
+    path.data[0]='\0';
+    if (absolute) {
+        appendText(&path,"/",1);
+    }
+    while (*pattern=='/') {
+        ++pattern;
+    }
+    walkPattern(matches,dirFd,&path,pattern,0);
+    freeText(&path);
+    close(dirFd);
+    size_t number=matches->number-first;
+    char ** keys=(char**)malloc(sizeof(char*)*number*2);
+    size_t i=0;
+    for (i=0;i!=number;++i) {
+        keys[i]=matches->names.data+matches->offsets[first+i];
+    }
+    sortPaths(keys,number,0,keys+number,0);
+    for (i=0;i!=number;++i) {
+        matches->offsets[first+i]=keys[i]-matches->names.data;
+    }
+    free(keys);
+    return number;
+}
@@ -0,0 +1,28 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+#include "util.h"
+
+#define WILDCARD_BUFFER_SIZE (256 * 1024)
+#define WILDCARD_MAX_DEPTH 64
+#define WILDCARD_INSERTION_SORT 32
+#define WILDCARD_RADIX_LEVELS 16
+
+/*
+    WildcardMatches collects the paths a pattern matched: names holds
+    them one after the other, each terminated by '\0', and offsets
+    where each starts, so that no entry needs an allocation of its
+    own.
+*/
+typedef struct WildcardMatches {
+    TextBuffer names;
+    size_t * offsets;
+    size_t number;
+    size_t capacity;
+} WildcardMatches;
+
+bool hasWildcard(const char * word);
+bool matchPattern(const char * pattern, size_t length, const char * name);
+void initMatches(WildcardMatches * matches);
+void freeMatches(WildcardMatches * matches);
+size_t expandWildcard(const char * pattern, WildcardMatches * matches);
+#endif //WILDCARD_H